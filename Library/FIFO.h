@@ -14,26 +14,76 @@
 // new types
 #include "types.h"
 
-// Number of bytes in a FIFO
-#define FIFO_SIZE 256
+// Largest FIFO allowed, so that the free-running indices can always tell a full FIFO from an empty one
+#define FIFO_MAX_SIZE 32768
+
+// Sets up a FIFO in an array of bytes, taking the size from the array
+#define FIFO_INIT(FIFO, storage) FIFO_Init((FIFO), (storage), sizeof(storage))
+
+/*!
+ * @struct TFIFOStats
+ */
+typedef struct
+{
+  uint16_t peak;		/*!< The most bytes that have been in the FIFO at once */
+  uint32_t nbIn;		/*!< The number of bytes put in */
+  uint32_t nbOut;		/*!< The number of bytes taken out */
+  uint32_t nbOverflows;		/*!< The number of bytes that were turned away because the FIFO was full */
+  uint32_t nbEmptyGets;		/*!< The number of times data was asked for while the FIFO was empty */
+} TFIFOStats;
 
 /*!
  * @struct TFIFO
  */
 typedef struct
 {
-  uint16_t Start;		/*!< The index of the position of the oldest data in the FIFO */
-  uint16_t End; 		/*!< The index of the next available empty position in the FIFO */
-  uint16_t volatile NbBytes;	/*!< The number of bytes currently stored in the FIFO */
-  uint8_t Buffer[FIFO_SIZE];	/*!< The actual array of bytes to store the data */
+  uint16_t volatile Start;	/*!< The free-running index of the oldest data in the FIFO, only changed by the reader */
+  uint16_t volatile End; 	/*!< The free-running index of the next empty position in the FIFO, only changed by the writer */
+  uint16_t Mask;		/*!< The size of Buffer minus 1, to turn a free-running index into a position */
+  uint8_t* Buffer;		/*!< The array of bytes to store the data, a power of 2 in size */
+  TFIFOStats Stats;		/*!< How the FIFO has been used, the put counts kept by the writer and the get counts by the reader */
 } TFIFO;
 
+/*!
+ * @struct TFIFOSpan
+ */
+typedef struct
+{
+  uint8_t* data1;		/*!< The first part of the space, up to the end of the buffer */
+  uint16_t length1;		/*!< The number of bytes in the first part */
+  uint8_t* data2;		/*!< The rest of the space, from the start of the buffer */
+  uint16_t length2;		/*!< The number of bytes in the rest */
+} TFIFOSpan;
+
 /*! @brief Initialize the FIFO before first use.
  *
  *  @param FIFO A pointer to the FIFO that needs initializing.
- *  @return void
+ *  @param buffer The storage for the FIFO's data.
+ *  @param size The number of bytes in buffer, which must be a power of 2 (2 to FIFO_MAX_SIZE).
+ *  @return bool - TRUE if the FIFO was successfully initialized.
  */
-void FIFO_Init(TFIFO* const FIFO);
+bool FIFO_Init(TFIFO* const FIFO, uint8_t* const buffer, const uint16_t size);
+
+/*! @brief Gets the number of bytes the FIFO can hold.
+ *
+ *  @param FIFO A pointer to the FIFO.
+ *  @return uint16_t - The size of the FIFO's buffer.
+ */
+uint16_t FIFO_Size(const TFIFO* const FIFO);
+
+/*! @brief Gets the number of bytes in the FIFO.
+ *
+ *  @param FIFO A pointer to the FIFO.
+ *  @return uint16_t - The number of bytes currently stored in the FIFO.
+ */
+uint16_t FIFO_Count(const TFIFO* const FIFO);
+
+/*! @brief Clears the usage statistics of the FIFO, with the peak starting again at the current count.
+ *
+ *  @param FIFO A pointer to the FIFO.
+ *  @note A put or get at the same time may be counted or lost, which is good enough for diagnostics.
+ */
+void FIFO_ResetStats(TFIFO* const FIFO);
 
 /*! @brief Put one character into the FIFO.
  *
@@ -53,4 +103,76 @@ bool FIFO_Put(TFIFO* const FIFO, const uint8_t data);
  */
 bool FIFO_Get(TFIFO* const FIFO, uint8_t* const dataPtr);
 
+/*! @brief Puts a block of bytes into the FIFO, copying at most two contiguous pieces.
+ *
+ *  @param FIFO A pointer to a FIFO struct where data is to be stored.
+ *  @param data The bytes to store.
+ *  @param nbBytes The number of bytes to store.
+ *  @return uint16_t - The number of bytes stored, which is less than nbBytes if the FIFO filled up.
+ *  @note Assumes that FIFO_Init has been called.
+ */
+uint16_t FIFO_PutN(TFIFO* const FIFO, const uint8_t* const data, const uint16_t nbBytes);
+
+/*! @brief Gets a block of bytes from the FIFO, copying at most two contiguous pieces.
+ *
+ *  @param FIFO A pointer to a FIFO struct with data to be retrieved.
+ *  @param data Where to place the retrieved bytes.
+ *  @param nbBytes The most bytes to retrieve.
+ *  @return uint16_t - The number of bytes retrieved, which is less than nbBytes if the FIFO ran out.
+ *  @note Assumes that FIFO_Init has been called.
+ */
+uint16_t FIFO_GetN(TFIFO* const FIFO, uint8_t* const data, const uint16_t nbBytes);
+
+/*! @brief Describes the data in the FIFO so that it can be read in place.
+ *
+ *  @param FIFO A pointer to a FIFO struct with data to be read.
+ *  @param span A pointer to where the data waiting to be read is described.
+ *  @return uint16_t - The number of bytes in span.
+ *  @note The data stays in the FIFO until FIFO_Consume is called.
+ */
+uint16_t FIFO_Peek(const TFIFO* const FIFO, TFIFOSpan* const span);
+
+/*! @brief Removes the oldest bytes from the FIFO once they have been read in place.
+ *
+ *  @param FIFO A pointer to the FIFO that was peeked at.
+ *  @param nbBytes The number of bytes read, which must be no more than FIFO_Peek returned.
+ */
+void FIFO_Consume(TFIFO* const FIFO, const uint16_t nbBytes);
+
+/*! @brief Reserves space at the end of the FIFO to be written in place.
+ *
+ *  @param FIFO A pointer to a FIFO struct where data is to be stored.
+ *  @param nbBytes The number of bytes to reserve.
+ *  @param span A pointer to where the reserved space is described.
+ *  @return bool - TRUE if there was room for nbBytes.
+ *  @note Only one reservation can be outstanding, so the caller must stop other writers until FIFO_Commit.
+ *        The reader may keep taking data out in the meantime.
+ */
+bool FIFO_Reserve(TFIFO* const FIFO, const uint16_t nbBytes, TFIFOSpan* const span);
+
+/*! @brief Adds the first bytes of the reserved space to the FIFO.
+ *
+ *  @param FIFO A pointer to the FIFO that space was reserved in.
+ *  @param nbBytes The number of bytes written, which can be less than were reserved.
+ *  @note Assumes that FIFO_Reserve has been called.
+ */
+void FIFO_Commit(TFIFO* const FIFO, const uint16_t nbBytes);
+
+/*! @brief Writes one byte of a reservation.
+ *
+ *  @param span The reserved space.
+ *  @param index The position within the reservation.
+ *  @param data The byte to write.
+ */
+void FIFO_SpanWrite(const TFIFOSpan* const span, const uint16_t index, const uint8_t data);
+
+/*! @brief Writes a block of bytes into a reservation.
+ *
+ *  @param span The reserved space.
+ *  @param index The position within the reservation of the first byte.
+ *  @param data The bytes to write.
+ *  @param nbBytes The number of bytes to write, which must fit in the reservation.
+ */
+void FIFO_SpanCopy(const TFIFOSpan* const span, const uint16_t index, const uint8_t* const data, const uint16_t nbBytes);
+
 #endif
@@ -14,6 +14,152 @@
 // new types
 #include "types.h"
 
+// FIFO spans, for writing straight into the transmit FIFO
+#include "FIFO.h"
+
+// Directions that can be moved to DMA with UART_PortEnableDMA
+#define UART_DMA_RX 0x01
+#define UART_DMA_TX 0x02
+
+// A UART and its receive and transmit FIFOs, only used through the UART_Port functions
+typedef struct UARTPort TUARTPort;
+
+extern TUARTPort UART_Port1;	/*!< UART1 on PTE0 (TX) and PTE1 (RX), clocked by the core clock. */
+extern TUARTPort UART_Port2;	/*!< UART2 on PTE16 (TX) and PTE17 (RX), the tower's RS232 port, clocked by the bus clock. */
+
+/*! @brief Sets up a UART before first use.
+ *
+ *  @param port The UART to set up.
+ *  @param baudRate The desired baud rate in bits/sec.
+ *  @param moduleClk The module clock rate of the UART in Hz.
+ *  @return bool - TRUE if the UART was successfully initialized.
+ */
+bool UART_PortInit(TUARTPort* const port, const uint32_t baudRate, const uint32_t moduleClk);
+
+/*! @brief Get a character from a receive FIFO if it is not empty.
+ *
+ *  @param port The UART to read from.
+ *  @param dataPtr A pointer to memory to store the retrieved byte.
+ *  @return bool - TRUE if the receive FIFO returned a character.
+ *  @note Assumes that UART_PortInit has been called.
+ */
+bool UART_PortInChar(TUARTPort* const port, uint8_t* const dataPtr);
+
+/*! @brief Describes the bytes waiting in a receive FIFO so that they can be parsed in place.
+ *
+ *  @param port The UART.
+ *  @param span A pointer to where the waiting bytes are described.
+ *  @return uint16_t - The number of bytes in span.
+ *  @note The bytes stay in the FIFO until UART_PortInConsume is called.
+ */
+uint16_t UART_PortInPeek(TUARTPort* const port, TFIFOSpan* const span);
+
+/*! @brief Removes the oldest bytes from a receive FIFO once they have been parsed in place.
+ *
+ *  @param port The UART.
+ *  @param nbBytes The number of bytes parsed, no more than UART_PortInPeek returned.
+ *  @note UART_PortInStamp then gives when the last of them arrived.
+ */
+void UART_PortInConsume(TUARTPort* const port, const uint16_t nbBytes);
+
+/*! @brief Gets the number of bytes waiting in a receive FIFO.
+ *
+ *  @param port The UART.
+ *  @return uint16_t - The number of received bytes not yet read by UART_PortInChar.
+ */
+uint16_t UART_PortInCount(TUARTPort* const port);
+
+/*! @brief Gets when the byte most recently returned by UART_PortInChar arrived.
+ *
+ *  @param port The UART.
+ *  @return uint32_t - The value of Cycles_Get when the byte was received.
+ */
+uint32_t UART_PortInStamp(const TUARTPort* const port);
+
+/*! @brief Gets the number of received bytes thrown away because the receive FIFO was full.
+ *
+ *  @param port The UART.
+ *  @return uint32_t - The number of bytes lost since UART_PortInit or UART_PortResetStats.
+ */
+uint32_t UART_PortInDropped(const TUARTPort* const port);
+
+/*! @brief Gets the usage statistics of a UART's FIFOs.
+ *
+ *  @param port The UART.
+ *  @param rx Where the statistics of the receive FIFO are copied.
+ *  @param tx Where the statistics of the transmit FIFO are copied.
+ */
+void UART_PortGetStats(const TUARTPort* const port, TFIFOStats* const rx, TFIFOStats* const tx);
+
+/*! @brief Clears the usage statistics of a UART's FIFOs.
+ *
+ *  @param port The UART.
+ */
+void UART_PortResetStats(TUARTPort* const port);
+
+/*! @brief Gets the number of bytes waiting to be sent.
+ *
+ *  @param port The UART.
+ *  @return uint16_t - The number of bytes in the transmit FIFO.
+ */
+uint16_t UART_PortOutCount(const TUARTPort* const port);
+
+/*! @brief Gets the number of bytes that can still be put in a transmit FIFO.
+ *
+ *  @param port The UART.
+ *  @return uint16_t - The free space in the transmit FIFO.
+ */
+uint16_t UART_PortOutSpace(const TUARTPort* const port);
+
+/*! @brief Put a byte in a transmit FIFO if it is not full.
+ *
+ *  @param port The UART to send on.
+ *  @param data The byte to be placed in the transmit FIFO.
+ *  @return bool - TRUE if the data was placed in the transmit FIFO.
+ *  @note Assumes that UART_PortInit has been called.
+ */
+bool UART_PortOutChar(TUARTPort* const port, const uint8_t data);
+
+/*! @brief Reserves space in a transmit FIFO so that bytes can be written straight into it.
+ *
+ *  @param port The UART to send on.
+ *  @param nbBytes The number of bytes to reserve.
+ *  @param span A pointer to where the reserved space is described.
+ *  @return bool - TRUE if the transmit FIFO had room for nbBytes.
+ *  @note Other writers to the transmit FIFO must be stopped until UART_PortOutCommit is called.
+ */
+bool UART_PortOutReserve(TUARTPort* const port, const uint16_t nbBytes, TFIFOSpan* const span);
+
+/*! @brief Sends the first bytes of the space reserved by UART_PortOutReserve.
+ *
+ *  @param port The UART to send on.
+ *  @param nbBytes The number of bytes that were written.
+ *  @note Assumes that UART_PortOutReserve has been called.
+ */
+void UART_PortOutCommit(TUARTPort* const port, const uint16_t nbBytes);
+
+/*! @brief Poll a UART's status register to try and receive and/or transmit one character.
+ *
+ *  @param port The UART to poll.
+ *  @note Assumes that UART_PortInit has been called. Directions using DMA are left to the DMA.
+ */
+void UART_PortPoll(TUARTPort* const port);
+
+/*! @brief Moves a UART's receiving and/or transmitting over to DMA.
+ *
+ *  Transmitting sends each contiguous run of the transmit FIFO with one DMA transfer. Receiving runs a DMA
+ *  channel around the receive FIFO's buffer, and received bytes are picked up from the DMA's position
+ *  whenever they are read or counted, so they are stamped with when they were picked up rather than when
+ *  they arrived, and there is no idle line interrupt. Anything already in the receive FIFO is dropped.
+ *  @param port The UART.
+ *  @param mode UART_DMA_RX and/or UART_DMA_TX, for the directions to add.
+ *  @return bool - TRUE if the DMA was set up, FALSE if the receive buffer can not be used as a circular buffer.
+ *  @note Assumes that UART_PortInit has been called and interrupts are disabled. UART_PortInit goes back to interrupts.
+ */
+bool UART_PortEnableDMA(TUARTPort* const port, const uint8_t mode);
+
+// The functions below are the original single UART interface, and all use UART_Port2
+
 /*! @brief Sets up the UART interface before first use.
  *
  *  @param baudRate The desired baud rate in bits/sec.
@@ -30,6 +176,27 @@ bool UART_Init(const uint32_t baudRate, const uint32_t moduleClk);
  */
 bool UART_InChar(uint8_t* const dataPtr);
  
+/*! @brief Gets the number of bytes waiting in the receive FIFO.
+ *
+ *  @return uint16_t - The number of received bytes not yet read by UART_InChar.
+ *  @note Assumes that UART_Init has been called.
+ */
+uint16_t UART_InCount(void);
+ 
+/*! @brief Gets when the byte most recently returned by UART_InChar arrived.
+ *
+ *  @return uint32_t - The value of Cycles_Get when the byte was received.
+ *  @note Assumes that UART_InChar has returned a byte.
+ */
+uint32_t UART_InStamp(void);
+
+/*! @brief Gets the number of bytes waiting to be sent.
+ *
+ *  @return uint16_t - The number of bytes in the transmit FIFO.
+ *  @note Assumes that UART_Init has been called.
+ */
+uint16_t UART_OutCount(void);
+
 /*! @brief Put a byte in the transmit FIFO if it is not full.
  *
  *  @param data The byte to be placed in the transmit FIFO.
@@ -38,6 +205,22 @@ bool UART_InChar(uint8_t* const dataPtr);
  */
 bool UART_OutChar(const uint8_t data);
 
+/*! @brief Reserves space in the transmit FIFO so that bytes can be written straight into it.
+ *
+ *  @param nbBytes The number of bytes to reserve.
+ *  @param span A pointer to where the reserved space is described.
+ *  @return bool - TRUE if the transmit FIFO had room for nbBytes.
+ *  @note Other writers to the transmit FIFO must be stopped until UART_OutCommit is called.
+ */
+bool UART_OutReserve(const uint16_t nbBytes, TFIFOSpan* const span);
+
+/*! @brief Sends the first bytes of the space reserved by UART_OutReserve.
+ *
+ *  @param nbBytes The number of bytes that were written.
+ *  @note Assumes that UART_OutReserve has been called.
+ */
+void UART_OutCommit(const uint16_t nbBytes);
+
 /*! @brief Poll the UART status register to try and receive and/or transmit one character.
  *
  *  @return void
@@ -51,4 +234,16 @@ void UART_Poll(void);
  */
 void __attribute__ ((interrupt)) UART_ISR(void);
 
+/*! @brief Interrupt service routine for UART1.
+ *
+ *  @note Assumes UART_PortInit has been called for UART_Port1.
+ */
+void __attribute__ ((interrupt)) UART1_ISR(void);
+
+/*! @brief Interrupt service routine for the DMA channels of both UARTs.
+ *
+ *  @note Shared by the vectors of channels 0 to 3.
+ */
+void __attribute__ ((interrupt)) UART_DMA_ISR(void);
+
 #endif
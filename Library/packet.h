@@ -14,9 +14,25 @@
 // New types
 #include "types.h"
 
+// Each link sends and receives on its own UART
+#include "UART.h"
+
 // Packet structure
 #define PACKET_NB_BYTES 5
 
+// Most data bytes that can be sent in one variable length frame
+#define PACKET_FRAME_MAX_BYTES 255
+
+// Most bytes in an encoded COBS frame: command, data and CRC, plus one code byte per 254 bytes
+#define PACKET_COBS_MAX_DECODED (1 + PACKET_FRAME_MAX_BYTES + 2)
+#define PACKET_COBS_MAX_ENCODED (PACKET_COBS_MAX_DECODED + PACKET_COBS_MAX_DECODED / 254 + 1)
+
+typedef enum
+{
+  PACKET_FRAMING_FIXED,		/*!< 5-byte packets with an XOR checksum. */
+  PACKET_FRAMING_COBS		/*!< Variable length COBS encoded frames with a CRC-16, ended by a zero byte. */
+} TPacketFraming;
+
 #pragma pack(push)
 #pragma pack(1)
 
@@ -51,6 +67,40 @@ typedef union
 
 #pragma pack(pop)
 
+/*!
+ * @struct TPacketLink
+ */
+typedef struct
+{
+  TUARTPort* port;				/*!< The UART the link sends and receives on */
+  TPacketFraming framing;			/*!< How packets are framed on this link */
+  TPacket packet;				/*!< The most recently received packet */
+  uint8_t frameLength;				/*!< The number of data bytes in the most recent COBS frame */
+  uint8_t frameData[PACKET_FRAME_MAX_BYTES];	/*!< The data bytes of the most recent COBS frame */
+  uint32_t rxStamp;				/*!< When the most recent packet finished arriving, from UART_PortInStamp */
+  uint32_t framingErrors;			/*!< The number of times sync has been lost (or a COBS frame was bad) */
+  uint32_t nbReceived;				/*!< The number of packets and frames received */
+  uint32_t nbSent;				/*!< The number of packets and frames sent */
+  uint32_t nbDropped;				/*!< The number of packets and frames not sent because the transmit FIFO was full */
+  uint8_t packetIndex;				/*!< How many bytes of the next 5-byte packet have been received */
+  uint8_t rxWindow[PACKET_NB_BYTES];		/*!< A ring of the last 5 bytes received */
+  uint8_t rxWindowStart;			/*!< The position of the oldest byte in rxWindow */
+  uint8_t rxWindowXOR;				/*!< The XOR of the bytes in rxWindow */
+  bool rxInSync;				/*!< FALSE once sync is lost, so that each loss is only counted once */
+  uint8_t rxFrame[PACKET_COBS_MAX_ENCODED];	/*!< The COBS frame being received */
+  uint16_t rxFrameIndex;			/*!< The number of bytes in rxFrame */
+  bool rxFrameOverflow;				/*!< TRUE to discard a frame that is too long */
+} TPacketLink;
+
+// The link on UART2 that commands arrive on, which the original Packet_ functions and variables use
+extern TPacketLink Packet_ControlLink;
+
+#define Packet                (Packet_ControlLink.packet)
+#define Packet_FrameLength    (Packet_ControlLink.frameLength)
+#define Packet_FrameData      (Packet_ControlLink.frameData)
+#define Packet_FramingErrors  (Packet_ControlLink.framingErrors)
+#define Packet_RxStamp        (Packet_ControlLink.rxStamp)
+
 #define Packet_Command     Packet.packetStruct.command
 #define Packet_Parameter1  Packet.packetStruct.parameters.separate.parameter1
 #define Packet_Parameter2  Packet.packetStruct.parameters.separate.parameter2
@@ -59,7 +109,19 @@ typedef union
 #define Packet_Parameter23 Packet.packetStruct.parameters.combined23.parameter23
 #define Packet_Checksum    Packet.packetStruct.checksum
 
-extern TPacket Packet;
+// The same fields of any packet, e.g. the one passed to a packet handler
+#define PACKET_COMMAND(packet)     ((packet)->packetStruct.command)
+#define PACKET_PARAMETER1(packet)  ((packet)->packetStruct.parameters.separate.parameter1)
+#define PACKET_PARAMETER2(packet)  ((packet)->packetStruct.parameters.separate.parameter2)
+#define PACKET_PARAMETER3(packet)  ((packet)->packetStruct.parameters.separate.parameter3)
+#define PACKET_PARAMETER12(packet) ((packet)->packetStruct.parameters.combined12.parameter12)
+#define PACKET_PARAMETER23(packet) ((packet)->packetStruct.parameters.combined23.parameter23)
+
+// Number of commands that can have a handler (the top bit of the command is the ACK bit)
+#define PACKET_NB_COMMANDS 128
+
+// A packet handler is given the decoded packet and returns TRUE if the command was carried out
+typedef bool (*TPacketHandler)(const TPacket* const packet);
 
 // Acknowledgment bit mask
 extern const uint8_t PACKET_ACK_MASK;
@@ -72,7 +134,25 @@ extern const uint8_t PACKET_ACK_MASK;
  */
 bool Packet_Init(const uint32_t baudRate, const uint32_t moduleClk);
 
+/*! @brief Selects how packets are framed on the serial port.
+ *
+ *  Any partly received packet is thrown away.
+ *  @param framing The framing to use for all packets from now on.
+ *  @return bool - TRUE if the framing is supported.
+ */
+bool Packet_SetFraming(const TPacketFraming framing);
+
+/*! @brief Gets the current framing.
+ *
+ *  @return TPacketFraming - The framing used for packets.
+ */
+TPacketFraming Packet_GetFraming(void);
+
 /*! @brief Attempts to get a packet from the received data.
+ *
+ *  With 5-byte packets, a packet is accepted if its checksum is good, so that an unknown command can be NAKed.
+ *  Otherwise the receiver is out of sync and slides along one byte at a time until it finds a good packet
+ *  whose command has a handler.
  *
  *  @return bool - TRUE if a valid packet was received.
  */
@@ -84,4 +164,82 @@ bool Packet_Get(void);
  */
 bool Packet_Put(const uint8_t command, const uint8_t parameter1, const uint8_t parameter2, const uint8_t parameter3);
 
+/*! @brief Registers the function that handles a command.
+ *
+ *  @param command The command, without the ACK bit.
+ *  @param handler The function to call for packets with this command, or NULL to remove the handler.
+ *  @return bool - TRUE if the handler was registered.
+ */
+bool Packet_RegisterHandler(const uint8_t command, const TPacketHandler handler);
+
+/*! @brief Checks whether a command has a handler.
+ *
+ *  @param command The command, with or without the ACK bit.
+ *  @return bool - TRUE if a handler is registered for the command.
+ */
+bool Packet_IsRegistered(const uint8_t command);
+
+/*! @brief Passes a packet to the handler registered for its command.
+ *
+ *  @param packet The packet to handle. The ACK bit of its command is ignored.
+ *  @return bool - TRUE if there is a handler for the command and it succeeded.
+ */
+bool Packet_Handle(const TPacket* const packet);
+
+/*! @brief Builds a variable length frame and places it in the transmit FIFO buffer.
+ *
+ *  With fixed framing, the frame is the command, the number of data bytes, the data bytes and then
+ *  a checksum which is the XOR of all of the preceding bytes.
+ *  With COBS framing, the frame is the command, the data bytes and the CRC-16.
+ *  @param command The frame's command.
+ *  @param data The frame's data.
+ *  @param nbBytes The number of data bytes (up to PACKET_FRAME_MAX_BYTES).
+ *  @return bool - TRUE if the frame was sent.
+ */
+bool Packet_PutFrame(const uint8_t command, const uint8_t* const data, const uint8_t nbBytes);
+
+/*! @brief Sets up a link and the UART it uses before first use.
+ *
+ *  The link starts with 5-byte packets and its statistics cleared.
+ *  @param link The link to set up.
+ *  @param port The UART to send and receive on.
+ *  @param baudRate The desired baud rate in bits/sec.
+ *  @param moduleClk The module clock rate of the UART in Hz.
+ *  @return bool - TRUE if the link was successfully initialized.
+ */
+bool Packet_LinkInit(TPacketLink* const link, TUARTPort* const port, const uint32_t baudRate, const uint32_t moduleClk);
+
+/*! @brief Selects how packets are framed on a link.
+ *
+ *  Any partly received packet is thrown away.
+ *  @param link The link.
+ *  @param framing The framing to use for all packets on the link from now on.
+ *  @return bool - TRUE if the framing is supported.
+ */
+bool Packet_LinkSetFraming(TPacketLink* const link, const TPacketFraming framing);
+
+/*! @brief Attempts to get a packet from the data received on a link.
+ *
+ *  @param link The link.
+ *  @return bool - TRUE if a valid packet was received, which is in link->packet.
+ */
+bool Packet_LinkGet(TPacketLink* const link);
+
+/*! @brief Builds a packet and places it in the transmit FIFO buffer of a link.
+ *
+ *  @param link The link to send on.
+ *  @return bool - TRUE if a valid packet was sent.
+ */
+bool Packet_LinkPut(TPacketLink* const link, const uint8_t command, const uint8_t parameter1, const uint8_t parameter2, const uint8_t parameter3);
+
+/*! @brief Builds a variable length frame and places it in the transmit FIFO buffer of a link.
+ *
+ *  @param link The link to send on.
+ *  @param command The frame's command.
+ *  @param data The frame's data.
+ *  @param nbBytes The number of data bytes (up to PACKET_FRAME_MAX_BYTES).
+ *  @return bool - TRUE if the frame was sent.
+ */
+bool Packet_LinkPutFrame(TPacketLink* const link, const uint8_t command, const uint8_t* const data, const uint8_t nbBytes);
+
 #endif
@@ -0,0 +1,64 @@
+/*! @file CRC16.c
+ *
+ *  @brief 16-bit cyclic redundancy check.
+ *
+ *  This contains the functions for calculating the CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF)
+ *  used to check variable length frames.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-22
+ */
+/*!
+**  @addtogroup main_module main module documentation
+**
+**  @author Thanit Tangson
+**  @{
+*/
+
+#include "CRC16.h"
+
+// CRC of each 4-bit value, so a byte takes two table lookups instead of 8 shifts (and 32 bytes instead of 512)
+static const uint16_t CRC16_NIBBLE[16] =
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+
+
+/*! @brief Adds one byte to a CRC.
+ *
+ *  @param crc The CRC of the bytes so far (CRC16_INITIAL for the first byte).
+ *  @param data The next byte.
+ *  @return uint16_t - The CRC including data.
+ */
+uint16_t CRC16_Update(const uint16_t crc, const uint8_t data)
+{
+  uint16_t result = crc;
+
+  result = (uint16_t)(result << 4) ^ CRC16_NIBBLE[(result >> 12) ^ (data >> 4)];
+  result = (uint16_t)(result << 4) ^ CRC16_NIBBLE[(result >> 12) ^ (data & 0x0F)];
+
+  return result;
+}
+
+
+
+/*! @brief Calculates the CRC of a block of bytes.
+ *
+ *  @param crc The CRC of any earlier bytes (CRC16_INITIAL to start a new CRC).
+ *  @param data The bytes to add.
+ *  @param nbBytes The number of bytes to add.
+ *  @return uint16_t - The CRC including the block.
+ */
+uint16_t CRC16_Block(uint16_t crc, const uint8_t* const data, const uint16_t nbBytes)
+{
+  for (uint16_t i = 0; i < nbBytes; i++)
+    crc = CRC16_Update(crc, data[i]);
+
+  return crc;
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,38 @@
+/*! @file
+ *
+ *  @brief 16-bit cyclic redundancy check.
+ *
+ *  This contains the functions for calculating the CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF)
+ *  used to check variable length frames.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-22
+ */
+
+#ifndef CRC16_H
+#define CRC16_H
+
+// New types
+#include "types.h"
+
+// Value to start a new CRC with
+#define CRC16_INITIAL 0xFFFF
+
+/*! @brief Adds one byte to a CRC.
+ *
+ *  @param crc The CRC of the bytes so far (CRC16_INITIAL for the first byte).
+ *  @param data The next byte.
+ *  @return uint16_t - The CRC including data.
+ */
+uint16_t CRC16_Update(const uint16_t crc, const uint8_t data);
+
+/*! @brief Calculates the CRC of a block of bytes.
+ *
+ *  @param crc The CRC of any earlier bytes (CRC16_INITIAL to start a new CRC).
+ *  @param data The bytes to add.
+ *  @param nbBytes The number of bytes to add.
+ *  @return uint16_t - The CRC including the block.
+ */
+uint16_t CRC16_Block(uint16_t crc, const uint8_t* const data, const uint16_t nbBytes);
+
+#endif
@@ -0,0 +1,286 @@
+/*! @file FFT.c
+ *
+ *  @brief Fixed-point FFT for vibration spectra.
+ *
+ *  This contains the functions for transforming blocks of accelerometer samples into Q15 spectra,
+ *  and for reducing a spectrum to its largest peaks and band energies so it can be sent to the PC.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-19
+ */
+/*!
+**  @addtogroup main_module main module documentation
+**
+**  @author Thanit Tangson
+**  @{
+*/
+
+/*
+
+Decimation in time: the samples are put in bit-reversed order and then log2(size) stages of
+butterflies combine pairs of smaller transforms. Halving the result of every butterfly keeps each
+stage inside Q15, so the output is the DFT divided by size and a full scale sine of amplitude A
+shows up as two bins of magnitude A/2.
+
+Only integer maths is used, so the same code runs on the tower and on a PC.
+
+*/
+
+#include "FFT.h"
+
+// Cycle counter for the benchmark
+#include "cycles.h"
+
+// sin(2*pi*i/FFT_MAX_SIZE) in Q15 for i = 0 .. 3/4 of a period, so cos(x) = sin(x + FFT_MAX_SIZE/4)
+#define FFT_SINE_SIZE (FFT_MAX_SIZE / 2 + FFT_MAX_SIZE / 4)
+
+static const int16_t FFT_SINE[FFT_SINE_SIZE] =
+{
+       0,    804,   1608,   2411,   3212,   4011,   4808,   5602,   6393,   7180,   7962,   8740,
+    9512,  10279,  11039,  11793,  12540,  13279,  14010,  14733,  15447,  16151,  16846,  17531,
+   18205,  18868,  19520,  20160,  20788,  21403,  22006,  22595,  23170,  23732,  24279,  24812,
+   25330,  25833,  26320,  26791,  27246,  27684,  28106,  28511,  28899,  29269,  29622,  29957,
+   30274,  30572,  30853,  31114,  31357,  31581,  31786,  31972,  32138,  32286,  32413,  32522,
+   32610,  32679,  32729,  32758,  32767,  32758,  32729,  32679,  32610,  32522,  32413,  32286,
+   32138,  31972,  31786,  31581,  31357,  31114,  30853,  30572,  30274,  29957,  29622,  29269,
+   28899,  28511,  28106,  27684,  27246,  26791,  26320,  25833,  25330,  24812,  24279,  23732,
+   23170,  22595,  22006,  21403,  20788,  20160,  19520,  18868,  18205,  17531,  16846,  16151,
+   15447,  14733,  14010,  13279,  12540,  11793,  11039,  10279,   9512,   8740,   7962,   7180,
+    6393,   5602,   4808,   4011,   3212,   2411,   1608,    804,      0,   -804,  -1608,  -2411,
+   -3212,  -4011,  -4808,  -5602,  -6393,  -7180,  -7962,  -8740,  -9512, -10279, -11039, -11793,
+  -12540, -13279, -14010, -14733, -15447, -16151, -16846, -17531, -18205, -18868, -19520, -20160,
+  -20788, -21403, -22006, -22595, -23170, -23732, -24279, -24812, -25330, -25833, -26320, -26791,
+  -27246, -27684, -28106, -28511, -28899, -29269, -29622, -29957, -30274, -30572, -30853, -31114,
+  -31357, -31581, -31786, -31972, -32138, -32286, -32413, -32522, -32610, -32679, -32729, -32758
+};
+
+// Buffer used by FFT_Benchmark
+static TComplex BenchmarkData[FFT_MAX_SIZE];
+
+// private function to reverse the lowest nbBits bits of an index
+static uint16_t BitReverse(uint16_t index, const uint8_t nbBits)
+{
+  uint16_t reversed = 0;
+
+  for (uint8_t bit = 0; bit < nbBits; bit++)
+  {
+    reversed = (reversed << 1) | (index & 1);
+    index  >>= 1;
+  }
+
+  return reversed;
+}
+
+
+
+/*! @brief Performs an in-place radix-2 FFT.
+ *
+ *  Each stage is scaled by 1/2 so the result can not overflow, i.e. the output is the DFT divided by size.
+ *  @param data size complex samples, replaced by their spectrum.
+ *  @param log2Size log2 of the number of samples (FFT_MIN_LOG2_SIZE to FFT_MAX_LOG2_SIZE).
+ *  @return bool - TRUE if the transform was performed.
+ */
+bool FFT_Transform(TComplex* const data, const uint8_t log2Size)
+{
+  if ((log2Size < FFT_MIN_LOG2_SIZE) || (log2Size > FFT_MAX_LOG2_SIZE))
+    return false;
+
+  const uint16_t size = 1 << log2Size;
+
+  // Put the samples in bit-reversed order
+  for (uint16_t i = 0; i < size; i++)
+  {
+    uint16_t j = BitReverse(i, log2Size);
+
+    if (j > i)
+    {
+      TComplex temp = data[i];
+      data[i] = data[j];
+      data[j] = temp;
+    }
+  }
+
+  // Combine pairs of transforms of length half into transforms of length 2 * half
+  for (uint16_t half = 1; half < size; half <<= 1)
+  {
+    const uint16_t step = FFT_MAX_SIZE / (2 * half); // twiddle table stride for this stage
+
+    for (uint16_t k = 0; k < half; k++)
+    {
+      // w = exp(-j*2*pi*k/(2*half)) = cos - j*sin
+      const int32_t wr = FFT_SINE[k * step + FFT_MAX_SIZE / 4];
+      const int32_t wi = -FFT_SINE[k * step];
+
+      for (uint16_t i = k; i < size; i += 2 * half)
+      {
+        TComplex* const a = &data[i];
+        TComplex* const b = &data[i + half];
+
+        int32_t tr = (b->re * wr - b->im * wi) >> 15;
+        int32_t ti = (b->re * wi + b->im * wr) >> 15;
+
+        b->re = (int16_t)((a->re - tr) >> 1);
+        b->im = (int16_t)((a->im - ti) >> 1);
+        a->re = (int16_t)((a->re + tr) >> 1);
+        a->im = (int16_t)((a->im + ti) >> 1);
+      }
+    }
+  }
+
+  return true;
+}
+
+
+
+/*! @brief Calculates the power in each bin from DC up to half the sample rate.
+ *
+ *  @param data A spectrum from FFT_Transform.
+ *  @param log2Size log2 of the size of the spectrum.
+ *  @param power Where size / 2 + 1 powers are stored.
+ */
+void FFT_Power(const TComplex* const data, const uint8_t log2Size, uint32_t* const power)
+{
+  const uint16_t nbBins = (1 << (log2Size - 1)) + 1;
+
+  for (uint16_t bin = 0; bin < nbBins; bin++)
+    power[bin] = (uint32_t)(data[bin].re * data[bin].re) + (uint32_t)(data[bin].im * data[bin].im);
+}
+
+
+
+/*! @brief Finds the largest local maxima of a power spectrum, ignoring DC.
+ *
+ *  @param power The power in each bin, from FFT_Power.
+ *  @param nbBins The number of bins in power.
+ *  @param peaks Where the peaks are stored, largest first.
+ *  @param nbPeaks The number of peaks wanted (up to FFT_MAX_PEAKS).
+ *  @return uint8_t - The number of peaks found, which may be less than nbPeaks.
+ */
+uint8_t FFT_Peaks(const uint32_t* const power, const uint16_t nbBins, TFFTPeak* const peaks, const uint8_t nbPeaks)
+{
+  uint8_t nbFound = 0;
+  uint8_t wanted  = (nbPeaks > FFT_MAX_PEAKS) ? FFT_MAX_PEAKS : nbPeaks;
+
+  for (uint16_t bin = 1; bin + 1 < nbBins; bin++)
+  {
+    uint32_t p = power[bin];
+
+    if ((p == 0) || (p < power[bin - 1]) || (p <= power[bin + 1]))
+      continue;
+
+    // Insertion sort into the short list of peaks found so far
+    uint8_t slot = nbFound;
+
+    while ((slot > 0) && (peaks[slot - 1].power < p))
+    {
+      if (slot < wanted)
+        peaks[slot] = peaks[slot - 1];
+      slot--;
+    }
+
+    if (slot < wanted)
+    {
+      peaks[slot].bin   = bin;
+      peaks[slot].power = p;
+      if (nbFound < wanted)
+        nbFound++;
+    }
+  }
+
+  return nbFound;
+}
+
+
+
+/*! @brief Sums the power spectrum into equal width bands, ignoring DC.
+ *
+ *  @param power The power in each bin, from FFT_Power.
+ *  @param nbBins The number of bins in power.
+ *  @param energies Where the energy of each band is stored.
+ *  @param nbBands The number of bands to split bins 1 to nbBins - 1 into.
+ */
+void FFT_Bands(const uint32_t* const power, const uint16_t nbBins, uint32_t* const energies, const uint8_t nbBands)
+{
+  const uint16_t nbUsed = nbBins - 1;
+
+  for (uint8_t band = 0; band < nbBands; band++)
+  {
+    uint16_t first = 1 + (uint16_t)(((uint32_t)band * nbUsed) / nbBands);
+    uint16_t last  = 1 + (uint16_t)(((uint32_t)(band + 1) * nbUsed) / nbBands);
+    uint32_t sum   = 0;
+
+    for (uint16_t bin = first; bin < last; bin++)
+    {
+      // Saturate rather than wrap if a band holds a lot of energy
+      sum = (sum + power[bin] < sum) ? UINT32_MAX : sum + power[bin];
+    }
+
+    energies[band] = sum;
+  }
+}
+
+
+
+/*! @brief Times one FFT of a test tone.
+ *
+ *  @param log2Size log2 of the transform size to time.
+ *  @return uint32_t - The number of cycles taken by FFT_Transform (counter ticks when built on a PC).
+ */
+uint32_t FFT_Benchmark(const uint8_t log2Size)
+{
+  if ((log2Size < FFT_MIN_LOG2_SIZE) || (log2Size > FFT_MAX_LOG2_SIZE))
+    return 0;
+
+  const uint16_t size = 1 << log2Size;
+
+  // A half scale tone in bin 5, so every butterfly does real work
+  for (uint16_t i = 0; i < size; i++)
+  {
+    BenchmarkData[i].re = FFT_SINE[(uint16_t)(i * 5 * (FFT_MAX_SIZE / size)) % FFT_SINE_SIZE] / 2;
+    BenchmarkData[i].im = 0;
+  }
+
+  uint32_t start = Cycles_Get();
+  (void)FFT_Transform(BenchmarkData, log2Size);
+  return Cycles_Get() - start;
+}
+
+
+
+#if !defined(__arm__)
+/*! @brief Reference DFT with the same scaling as FFT_Transform, for checking the FFT on a PC.
+ *
+ *  @param input size complex samples.
+ *  @param output Where the spectrum is stored.
+ *  @param log2Size log2 of the number of samples.
+ */
+void FFT_Reference(const TComplex* const input, TComplex* const output, const uint8_t log2Size)
+{
+  const uint16_t size = 1 << log2Size;
+
+  for (uint16_t bin = 0; bin < size; bin++)
+  {
+    int64_t sumRe = 0, sumIm = 0;
+
+    for (uint16_t n = 0; n < size; n++)
+    {
+      // Angle index in units of 2*pi/FFT_MAX_SIZE, wrapped to one period
+      uint16_t angle = (uint16_t)(((uint32_t)bin * n * (FFT_MAX_SIZE / size)) % FFT_MAX_SIZE);
+      int32_t s = (angle < FFT_SINE_SIZE) ? FFT_SINE[angle] : -FFT_SINE[angle - FFT_MAX_SIZE / 2];
+      uint16_t cosAngle = (uint16_t)((angle + FFT_MAX_SIZE / 4) % FFT_MAX_SIZE);
+      int32_t c = (cosAngle < FFT_SINE_SIZE) ? FFT_SINE[cosAngle] : -FFT_SINE[cosAngle - FFT_MAX_SIZE / 2];
+
+      // (re + j*im) * (c - j*s)
+      sumRe += (int64_t)input[n].re * c + (int64_t)input[n].im * s;
+      sumIm += (int64_t)input[n].im * c - (int64_t)input[n].re * s;
+    }
+
+    output[bin].re = (int16_t)(sumRe / ((int64_t)size << 15));
+    output[bin].im = (int16_t)(sumIm / ((int64_t)size << 15));
+  }
+}
+#endif
+
+/*!
+** @}
+*/
@@ -0,0 +1,97 @@
+/*! @file
+ *
+ *  @brief Fixed-point FFT for vibration spectra.
+ *
+ *  This contains the functions for transforming blocks of accelerometer samples into Q15 spectra,
+ *  and for reducing a spectrum to its largest peaks and band energies so it can be sent to the PC.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-19
+ */
+
+#ifndef FFT_H
+#define FFT_H
+
+// New types
+#include "types.h"
+
+// Smallest and largest transform sizes supported (powers of 2)
+#define FFT_MIN_LOG2_SIZE 6
+#define FFT_MAX_LOG2_SIZE 8
+#define FFT_MAX_SIZE      (1 << FFT_MAX_LOG2_SIZE)
+
+// Most spectral peaks that can be found at a time
+#define FFT_MAX_PEAKS 4
+
+/*!
+ * @struct TComplex
+ */
+typedef struct
+{
+  int16_t re;			/*!< The real part, Q15 */
+  int16_t im;			/*!< The imaginary part, Q15 */
+} TComplex;
+
+/*!
+ * @struct TFFTPeak
+ */
+typedef struct
+{
+  uint16_t bin;			/*!< The frequency bin of the peak (frequency = bin * sample rate / size) */
+  uint32_t power;		/*!< The power in the bin, re^2 + im^2 */
+} TFFTPeak;
+
+/*! @brief Performs an in-place radix-2 FFT.
+ *
+ *  Each stage is scaled by 1/2 so the result can not overflow, i.e. the output is the DFT divided by size.
+ *  @param data size complex samples, replaced by their spectrum.
+ *  @param log2Size log2 of the number of samples (FFT_MIN_LOG2_SIZE to FFT_MAX_LOG2_SIZE).
+ *  @return bool - TRUE if the transform was performed.
+ */
+bool FFT_Transform(TComplex* const data, const uint8_t log2Size);
+
+/*! @brief Calculates the power in each bin from DC up to half the sample rate.
+ *
+ *  @param data A spectrum from FFT_Transform.
+ *  @param log2Size log2 of the size of the spectrum.
+ *  @param power Where size / 2 + 1 powers are stored.
+ */
+void FFT_Power(const TComplex* const data, const uint8_t log2Size, uint32_t* const power);
+
+/*! @brief Finds the largest local maxima of a power spectrum, ignoring DC.
+ *
+ *  @param power The power in each bin, from FFT_Power.
+ *  @param nbBins The number of bins in power.
+ *  @param peaks Where the peaks are stored, largest first.
+ *  @param nbPeaks The number of peaks wanted (up to FFT_MAX_PEAKS).
+ *  @return uint8_t - The number of peaks found, which may be less than nbPeaks.
+ */
+uint8_t FFT_Peaks(const uint32_t* const power, const uint16_t nbBins, TFFTPeak* const peaks, const uint8_t nbPeaks);
+
+/*! @brief Sums the power spectrum into equal width bands, ignoring DC.
+ *
+ *  @param power The power in each bin, from FFT_Power.
+ *  @param nbBins The number of bins in power.
+ *  @param energies Where the energy of each band is stored.
+ *  @param nbBands The number of bands to split bins 1 to nbBins - 1 into.
+ */
+void FFT_Bands(const uint32_t* const power, const uint16_t nbBins, uint32_t* const energies, const uint8_t nbBands);
+
+/*! @brief Times one FFT of a test tone.
+ *
+ *  @param log2Size log2 of the transform size to time.
+ *  @return uint32_t - The number of cycles taken by FFT_Transform (counter ticks when built on a PC).
+ */
+uint32_t FFT_Benchmark(const uint8_t log2Size);
+
+#if !defined(__arm__)
+/*! @brief Reference DFT with the same scaling as FFT_Transform, for checking the FFT on a PC.
+ *
+ *  @param input size complex samples.
+ *  @param output Where the spectrum is stored.
+ *  @param log2Size log2 of the number of samples.
+ */
+void FFT_Reference(const TComplex* const input, TComplex* const output, const uint8_t log2Size);
+#endif
+
+#endif
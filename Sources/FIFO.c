@@ -0,0 +1,359 @@
+/*! @file
+ *
+ *  @brief Routines to implement a FIFO buffer.
+ *
+ *  This contains the structure and "methods" for accessing a byte-wide FIFO.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-22
+ */
+/*!
+**  @addtogroup main_module main module documentation
+**
+**  @author Thanit Tangson
+**  @{
+*/
+
+/*
+
+Bytes can be added one at a time with FIFO_Put, or a whole packet at a time by reserving space with
+FIFO_Reserve, writing the bytes straight into the buffer and then making them visible to the reader
+with FIFO_Commit. The reserved space may wrap around the end of the buffer, so it is given as two
+segments, the second of which is often empty. Reading works the same way: FIFO_Peek describes the
+waiting data as two segments and FIFO_Consume removes what has been read. FIFO_PutN and FIFO_GetN copy
+blocks with at most two memcpy calls.
+
+Every FIFO counts how it is used in Stats, so that its size can be checked against real traffic. The
+writer keeps the put counts and the peak, and the reader the get counts, so they never share a counter.
+
+Each FIFO has one writer and one reader, e.g. an ISR and the main loop. Start is only changed by the
+reader and End only by the writer, and both run freely, wrapping at 65536, so the number of bytes in the
+FIFO is End - Start and a position in Buffer is the index masked with Mask. Nothing is shared that
+both sides change, so neither side ever has to disable interrupts. The writer fills Buffer before moving
+End, and the reader takes the data out before moving Start, with a compiler barrier in between so the
+order can not be changed. Several writers (or readers) of the same FIFO must still take turns themselves.
+
+*/
+
+#include "FIFO.h"
+
+// Needed for the defintion of NULL pointer
+#include "PE_Types.h"
+
+// memcpy for the block copies
+#include <string.h>
+
+// Stops the compiler moving accesses to Buffer past an update of Start or End
+#define FIFO_BARRIER() __asm volatile ("" ::: "memory")
+
+// private function to count bytes that have just been added, and the peak they make
+static void CountIn(TFIFO* const FIFO, const uint16_t nbBytes)
+{
+  uint16_t count = FIFO_Count(FIFO);
+
+  FIFO->Stats.nbIn += nbBytes;
+
+  if (count > FIFO->Stats.peak)
+    FIFO->Stats.peak = count;
+}
+
+
+
+/*! @brief Initialize the FIFO before first use.
+ *
+ *  @param FIFO A pointer to the FIFO that needs initializing.
+ *  @param buffer The storage for the FIFO's data.
+ *  @param size The number of bytes in buffer, which must be a power of 2 (2 to FIFO_MAX_SIZE).
+ *  @return bool - TRUE if the FIFO was successfully initialized.
+ */
+bool FIFO_Init(TFIFO* const FIFO, uint8_t* const buffer, const uint16_t size)
+{
+  // A power of 2 has only one bit set, so that masking works
+  if ((buffer == NULL) || (size < 2) || (size > FIFO_MAX_SIZE) || (size & (size - 1)))
+    return false;
+
+  FIFO->Start  = 0;
+  FIFO->End    = 0;
+  FIFO->Mask   = size - 1;
+  FIFO->Buffer = buffer;
+  FIFO_ResetStats(FIFO);
+  return true;
+}
+
+
+
+/*! @brief Gets the number of bytes the FIFO can hold.
+ *
+ *  @param FIFO A pointer to the FIFO.
+ *  @return uint16_t - The size of the FIFO's buffer.
+ */
+uint16_t FIFO_Size(const TFIFO* const FIFO)
+{
+  return FIFO->Mask + 1;
+}
+
+
+
+/*! @brief Clears the usage statistics of the FIFO, with the peak starting again at the current count.
+ *
+ *  @param FIFO A pointer to the FIFO.
+ *  @note A put or get at the same time may be counted or lost, which is good enough for diagnostics.
+ */
+void FIFO_ResetStats(TFIFO* const FIFO)
+{
+  FIFO->Stats.peak        = FIFO_Count(FIFO);
+  FIFO->Stats.nbIn        = 0;
+  FIFO->Stats.nbOut       = 0;
+  FIFO->Stats.nbOverflows = 0;
+  FIFO->Stats.nbEmptyGets = 0;
+}
+
+
+
+/*! @brief Gets the number of bytes in the FIFO.
+ *
+ *  @param FIFO A pointer to the FIFO.
+ *  @return uint16_t - The number of bytes currently stored in the FIFO.
+ */
+uint16_t FIFO_Count(const TFIFO* const FIFO)
+{
+  return (uint16_t)(FIFO->End - FIFO->Start);
+}
+
+
+
+/*! @brief Put one character into the FIFO.
+ *
+ *  @param FIFO A pointer to a FIFO struct where data is to be stored.
+ *  @param data A byte of data to store in the FIFO buffer.
+ *  @return bool - TRUE if data is successfully stored in the FIFO.
+ *  @note Assumes that FIFO_Init has been called.
+ */
+bool FIFO_Put(TFIFO* const FIFO, const uint8_t data)
+{
+  uint16_t end = FIFO->End;
+
+  if ((uint16_t)(end - FIFO->Start) > FIFO->Mask)
+  {
+    FIFO->Stats.nbOverflows++;
+    return false;
+  }
+
+  FIFO->Buffer[end & FIFO->Mask] = data;
+  FIFO_BARRIER();
+  FIFO->End = end + 1;
+  CountIn(FIFO, 1);
+  return true;
+}
+
+
+
+/*! @brief Get one character from the FIFO.
+ *
+ *  @param FIFO A pointer to a FIFO struct with data to be retrieved.
+ *  @param dataPtr A pointer to a memory location to place the retrieved byte.
+ *  @return bool - TRUE if data is successfully retrieved from the FIFO.
+ *  @note Assumes that FIFO_Init has been called.
+ */
+bool FIFO_Get(TFIFO* const FIFO, uint8_t* const dataPtr)
+{
+  uint16_t start = FIFO->Start;
+
+  if (FIFO->End == start)
+  {
+    FIFO->Stats.nbEmptyGets++;
+    return false;
+  }
+
+  *dataPtr = FIFO->Buffer[start & FIFO->Mask];
+  FIFO_BARRIER();
+  FIFO->Start = start + 1;
+  FIFO->Stats.nbOut++;
+  return true;
+}
+
+
+
+/*! @brief Puts a block of bytes into the FIFO, copying at most two contiguous pieces.
+ *
+ *  @param FIFO A pointer to a FIFO struct where data is to be stored.
+ *  @param data The bytes to store.
+ *  @param nbBytes The number of bytes to store.
+ *  @return uint16_t - The number of bytes stored, which is less than nbBytes if the FIFO filled up.
+ *  @note Assumes that FIFO_Init has been called.
+ */
+uint16_t FIFO_PutN(TFIFO* const FIFO, const uint8_t* const data, const uint16_t nbBytes)
+{
+  uint16_t space = FIFO_Size(FIFO) - FIFO_Count(FIFO);
+  uint16_t count = (nbBytes < space) ? nbBytes : space;
+  TFIFOSpan span;
+
+  FIFO->Stats.nbOverflows += nbBytes - count;
+
+  if (count == 0)
+    return 0;
+
+  (void)FIFO_Reserve(FIFO, count, &span);
+  FIFO_SpanCopy(&span, 0, data, count);
+  FIFO_Commit(FIFO, count);
+  return count;
+}
+
+
+
+/*! @brief Gets a block of bytes from the FIFO, copying at most two contiguous pieces.
+ *
+ *  @param FIFO A pointer to a FIFO struct with data to be retrieved.
+ *  @param data Where to place the retrieved bytes.
+ *  @param nbBytes The most bytes to retrieve.
+ *  @return uint16_t - The number of bytes retrieved, which is less than nbBytes if the FIFO ran out.
+ *  @note Assumes that FIFO_Init has been called.
+ */
+uint16_t FIFO_GetN(TFIFO* const FIFO, uint8_t* const data, const uint16_t nbBytes)
+{
+  TFIFOSpan span;
+  uint16_t available = FIFO_Peek(FIFO, &span);
+  uint16_t count     = (nbBytes < available) ? nbBytes : available;
+  uint16_t count1    = (count < span.length1) ? count : span.length1;
+
+  if ((available == 0) && (nbBytes > 0))
+    FIFO->Stats.nbEmptyGets++;
+
+  memcpy(data, span.data1, count1);
+  memcpy(&data[count1], span.data2, count - count1);
+
+  FIFO_Consume(FIFO, count);
+  return count;
+}
+
+
+
+/*! @brief Describes the data in the FIFO so that it can be read in place.
+ *
+ *  @param FIFO A pointer to a FIFO struct with data to be read.
+ *  @param span A pointer to where the data waiting to be read is described.
+ *  @return uint16_t - The number of bytes in span.
+ *  @note The data stays in the FIFO until FIFO_Consume is called.
+ */
+uint16_t FIFO_Peek(const TFIFO* const FIFO, TFIFOSpan* const span)
+{
+  uint16_t start = FIFO->Start & FIFO->Mask;
+  uint16_t toEnd = FIFO_Size(FIFO) - start;
+  uint16_t count = FIFO_Count(FIFO);
+
+  // The data is read after the count, so the writer can only have added to it
+  FIFO_BARRIER();
+
+  span->data1   = (uint8_t*)&FIFO->Buffer[start];
+  span->length1 = (count < toEnd) ? count : toEnd;
+  span->data2   = (uint8_t*)FIFO->Buffer;
+  span->length2 = count - span->length1;
+
+  return count;
+}
+
+
+
+/*! @brief Removes the oldest bytes from the FIFO once they have been read in place.
+ *
+ *  @param FIFO A pointer to the FIFO that was peeked at.
+ *  @param nbBytes The number of bytes read, which must be no more than FIFO_Peek returned.
+ */
+void FIFO_Consume(TFIFO* const FIFO, const uint16_t nbBytes)
+{
+  FIFO_BARRIER();
+  FIFO->Start += nbBytes;
+  FIFO->Stats.nbOut += nbBytes;
+}
+
+
+
+/*! @brief Reserves space at the end of the FIFO to be written in place.
+ *
+ *  @param FIFO A pointer to a FIFO struct where data is to be stored.
+ *  @param nbBytes The number of bytes to reserve.
+ *  @param span A pointer to where the reserved space is described.
+ *  @return bool - TRUE if there was room for nbBytes.
+ *  @note Only one reservation can be outstanding, so the caller must stop other writers until FIFO_Commit.
+ *        The reader may keep taking data out in the meantime.
+ */
+bool FIFO_Reserve(TFIFO* const FIFO, const uint16_t nbBytes, TFIFOSpan* const span)
+{
+  uint16_t end   = FIFO->End & FIFO->Mask;
+  uint16_t toEnd = FIFO_Size(FIFO) - end;
+
+  if (nbBytes > FIFO_Size(FIFO) - FIFO_Count(FIFO))
+  {
+    FIFO->Stats.nbOverflows += nbBytes;
+    return false;
+  }
+
+  span->data1   = &FIFO->Buffer[end];
+  span->length1 = (nbBytes < toEnd) ? nbBytes : toEnd;
+  span->data2   = FIFO->Buffer;
+  span->length2 = nbBytes - span->length1;
+
+  return true;
+}
+
+
+
+/*! @brief Adds the first bytes of the reserved space to the FIFO.
+ *
+ *  @param FIFO A pointer to the FIFO that space was reserved in.
+ *  @param nbBytes The number of bytes written, which can be less than were reserved.
+ *  @note Assumes that FIFO_Reserve has been called.
+ */
+void FIFO_Commit(TFIFO* const FIFO, const uint16_t nbBytes)
+{
+  FIFO_BARRIER();
+  FIFO->End += nbBytes;
+  CountIn(FIFO, nbBytes);
+}
+
+
+
+/*! @brief Writes one byte of a reservation.
+ *
+ *  @param span The reserved space.
+ *  @param index The position within the reservation.
+ *  @param data The byte to write.
+ */
+void FIFO_SpanWrite(const TFIFOSpan* const span, const uint16_t index, const uint8_t data)
+{
+  if (index < span->length1)
+    span->data1[index] = data;
+  else
+    span->data2[index - span->length1] = data;
+}
+
+
+
+/*! @brief Writes a block of bytes into a reservation.
+ *
+ *  @param span The reserved space.
+ *  @param index The position within the reservation of the first byte.
+ *  @param data The bytes to write.
+ *  @param nbBytes The number of bytes to write, which must fit in the reservation.
+ */
+void FIFO_SpanCopy(const TFIFOSpan* const span, const uint16_t index, const uint8_t* const data, const uint16_t nbBytes)
+{
+  uint16_t count1 = 0;
+
+  if (index < span->length1)
+  {
+    count1 = span->length1 - index;
+
+    if (count1 > nbBytes)
+      count1 = nbBytes;
+
+    memcpy(&span->data1[index], data, count1);
+  }
+
+  if (nbBytes > count1)
+    memcpy(&span->data2[index + count1 - span->length1], &data[count1], nbBytes - count1);
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,876 @@
+/*! @file
+ *
+ *  @brief I/O routines for UART communications on the TWR-K70F120M.
+ *
+ *  This contains the functions for operating the UART (serial port).
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-22
+ */
+/*!
+**  @addtogroup main_module main module documentation
+**
+**  @author Thanit Tangson
+**  @{
+*/
+
+/*
+
+UART2 is on PTE16 (TX) and PTE17 (RX), which is the serial port on the tower's RS232 board.
+UART1 is on PTE0 (TX) and PTE1 (RX), so that a second serial link can be wired up on the elevator.
+
+Each UART is a TUARTPort with its own FIFOs. Received bytes are put in the port's receive FIFO by its
+ISR. Bytes to send are taken from the transmit FIFO by the ISR while the transmit interrupt is enabled,
+which is turned on whenever something is added to the transmit FIFO.
+
+The UARTs' own hardware FIFOs are turned on (8 bytes each way on UART1 and 1 on UART2, as read from PFIFO), so
+one interrupt moves several bytes. The receive interrupt comes when the hardware FIFO is UART_RX_HEADROOM
+bytes short of full, leaving that many character times to get to it, and the transmit interrupt when it is
+down to UART_TX_LOW_WATER bytes, when it is filled up again. Bytes that stop short of the receive watermark,
+such as the end of a packet, are picked up by the idle line interrupt one character time after the line
+goes quiet. If they have all been taken already, the idle line interrupt is turned off and the watermark
+dropped to 1 until the next byte arrives, rather than clearing IDLE by reading an empty hardware FIFO.
+
+A port can be switched to DMA with UART_PortEnableDMA, so that the processor is no longer interrupted for
+every byte. For transmitting, a DMA channel is pointed at the contiguous run of bytes at the start of the
+transmit FIFO (the first segment from FIFO_Peek), fed by the UART's TDRE request. When it finishes the
+bytes are consumed and the next run is started. For receiving, a DMA channel writes into the receive FIFO's
+buffer as a circular buffer forever, using the eDMA's destination modulo so the buffer must be aligned to its
+size. Its interrupts at the half and full points of the buffer only count how far round it has gone. The
+reader (UART_PortInPeek, UART_PortInCount and UART_PortInChar) makes the bytes visible by moving End up to
+the DMA's write position, so a packet is seen as soon as its last byte arrives and End has only one writer.
+If the DMA has gone round and written over unread bytes, they are skipped and counted as overflows. Received
+bytes then all carry the stamp of when they were made visible, rather than when each one arrived.
+
+The FIFOs are sized for what each link carries. UART1 only streams data out, so it gets a large transmit
+FIFO that can absorb a burst of accelerometer packets and a small receive FIFO. UART2 carries commands
+and replies, so its transmit FIFO only has to hold the largest frame with some to spare.
+
+*/
+
+#include "UART.h"
+
+// Receive and transmit buffers
+#include "FIFO.h"
+
+// Cycle counter for timestamping received bytes
+#include "cycles.h"
+
+// CPU and PE_types are needed for the critical section when starting to transmit from the main loop
+#include "Cpu.h"
+#include "PE_Types.h"
+
+#include "MK70F12.h"
+
+// FIFO sizes in bytes, each a power of 2
+#define UART1_RX_SIZE 32
+#define UART1_TX_SIZE 2048
+#define UART2_RX_SIZE 256
+#define UART2_TX_SIZE 512
+
+#if (UART1_RX_SIZE & (UART1_RX_SIZE - 1)) || (UART1_TX_SIZE & (UART1_TX_SIZE - 1)) || \
+    (UART2_RX_SIZE & (UART2_RX_SIZE - 1)) || (UART2_TX_SIZE & (UART2_TX_SIZE - 1))
+#error "UART FIFO sizes must be powers of 2"
+#endif
+
+// Receive interrupt when the hardware FIFO has this much room left, transmit interrupt when it is down to this many bytes
+#define UART_RX_HEADROOM  2
+#define UART_TX_LOW_WATER 2
+
+// DMA channels for each direction of each UART, whose interrupt numbers are the same as the channels
+#define UART1_RX_CHANNEL 0
+#define UART1_TX_CHANNEL 1
+#define UART2_RX_CHANNEL 2
+#define UART2_TX_CHANNEL 3
+
+// DMA request sources on DMAMUX0, see K70 manual pg 125
+#define UART1_RX_SOURCE 4
+#define UART1_TX_SOURCE 5
+#define UART2_RX_SOURCE 6
+#define UART2_TX_SOURCE 7
+
+// Most iterations of a DMA major loop with channel linking off
+#define DMA_MAX_ITERATIONS 0x7FFF
+
+/*!
+ * @struct UARTPort
+ */
+struct UARTPort
+{
+  UART_MemMapPtr uart;			/*!< The UART's registers */
+  volatile uint32_t* txPCR;		/*!< The pin control register of the TX pin */
+  volatile uint32_t* rxPCR;		/*!< The pin control register of the RX pin */
+  uint32_t clockGate;			/*!< The UART's bit in SIM_SCGC4 */
+  uint8_t irq;				/*!< The UART's status interrupt number */
+  uint8_t rxDepth;			/*!< The size of the UART's receive hardware FIFO */
+  uint8_t txDepth;			/*!< The size of the UART's transmit hardware FIFO */
+  uint8_t* rxBuffer;			/*!< The storage for rxFIFO */
+  uint16_t rxSize;			/*!< The number of bytes in rxBuffer */
+  uint8_t* txBuffer;			/*!< The storage for txFIFO */
+  uint16_t txSize;			/*!< The number of bytes in txBuffer */
+  uint32_t* rxStamps;			/*!< When each byte in rxFIFO arrived, at the same positions (rxSize of them) */
+  uint8_t rxChannel;			/*!< The DMA channel for receiving */
+  uint8_t txChannel;			/*!< The DMA channel for transmitting */
+  uint8_t rxSource;			/*!< The DMAMUX source of the UART's receive requests */
+  uint8_t txSource;			/*!< The DMAMUX source of the UART's transmit requests */
+  uint8_t dmaMode;			/*!< Which directions use DMA, UART_DMA_RX and/or UART_DMA_TX */
+  uint16_t volatile txDMALength;	/*!< The number of bytes the transmit DMA is sending, 0 if it is idle */
+  uint16_t volatile rxHalfLaps;		/*!< The number of halves of rxBuffer the receive DMA has filled */
+  TFIFO rxFIFO;				/*!< The bytes received */
+  TFIFO txFIFO;				/*!< The bytes waiting to be sent */
+  uint32_t inStamp;			/*!< When the byte last returned by UART_PortInChar arrived */
+};
+
+// private global storage for the FIFOs and receive timestamps
+// (receive buffers are aligned to their size for the DMA's destination modulo)
+static uint8_t Port1RxBuffer[UART1_RX_SIZE] __attribute__ ((aligned (UART1_RX_SIZE)));
+static uint8_t Port1TxBuffer[UART1_TX_SIZE];
+static uint32_t Port1RxStamps[UART1_RX_SIZE];
+static uint8_t Port2RxBuffer[UART2_RX_SIZE] __attribute__ ((aligned (UART2_RX_SIZE)));
+static uint8_t Port2TxBuffer[UART2_TX_SIZE];
+static uint32_t Port2RxStamps[UART2_RX_SIZE];
+
+TUARTPort UART_Port1 = { UART1_BASE_PTR, &PORTE_PCR0, &PORTE_PCR1, SIM_SCGC4_UART1_MASK, 47, 0, 0,
+                         Port1RxBuffer, UART1_RX_SIZE, Port1TxBuffer, UART1_TX_SIZE, Port1RxStamps,
+                         UART1_RX_CHANNEL, UART1_TX_CHANNEL, UART1_RX_SOURCE, UART1_TX_SOURCE };
+TUARTPort UART_Port2 = { UART2_BASE_PTR, &PORTE_PCR16, &PORTE_PCR17, SIM_SCGC4_UART2_MASK, 49, 0, 0,
+                         Port2RxBuffer, UART2_RX_SIZE, Port2TxBuffer, UART2_TX_SIZE, Port2RxStamps,
+                         UART2_RX_CHANNEL, UART2_TX_CHANNEL, UART2_RX_SOURCE, UART2_TX_SOURCE };
+
+// private function to put a received byte in the receive FIFO along with when it arrived
+static void ReceiveByte(TUARTPort* const port, const uint8_t data)
+{
+  // The ISR is the only writer, so the stamp can go in before FIFO_Put lets the reader see the byte
+  if (FIFO_Count(&port->rxFIFO) <= port->rxFIFO.Mask)
+    port->rxStamps[port->rxFIFO.End & port->rxFIFO.Mask] = Cycles_Get();
+
+  (void)FIFO_Put(&port->rxFIFO, data); // a full FIFO counts the byte as an overflow
+}
+
+// private function to turn a size field of PFIFO into a number of bytes
+static uint8_t HardwareDepth(const uint8_t size)
+{
+  return (size == 0) ? 1 : (uint8_t)(1 << (size + 1));
+}
+
+// private function to get the receive watermark that leaves UART_RX_HEADROOM bytes spare in the hardware FIFO
+static uint8_t RxWatermark(const TUARTPort* const port)
+{
+  return (port->rxDepth > UART_RX_HEADROOM) ? port->rxDepth - UART_RX_HEADROOM : 1;
+}
+
+// private function to move everything in the receive hardware FIFO to the receive FIFO
+static void DrainRx(TUARTPort* const port)
+{
+  UART_MemMapPtr uart = port->uart;
+  uint8_t count = UART_RCFIFO_REG(uart);
+
+  // IDLE is cleared by reading D after S1, but reading an empty hardware FIFO underflows it and needs a flush,
+  // which could throw away a byte arriving at the same time. So when the last bytes have already been taken,
+  // leave IDLE set and let the next byte interrupt on its own, and the read of that byte clears IDLE.
+  if (count == 0)
+  {
+    UART_C2_REG(uart) &= ~UART_C2_ILIE_MASK;
+    UART_RWFIFO_REG(uart) = 1;
+    return;
+  }
+
+  for (; count > 0; count--)
+    ReceiveByte(port, UART_D_REG(uart));
+
+  if (!(UART_C2_REG(uart) & UART_C2_ILIE_MASK))
+  {
+    UART_RWFIFO_REG(uart) = RxWatermark(port);
+    UART_C2_REG(uart) |= UART_C2_ILIE_MASK;
+  }
+}
+
+// private function to top up the transmit hardware FIFO from the transmit FIFO
+static void FillTx(TUARTPort* const port)
+{
+  UART_MemMapPtr uart = port->uart;
+  uint8_t room = port->txDepth - UART_TCFIFO_REG(uart);
+  TFIFOSpan span;
+  uint16_t count = FIFO_Peek(&port->txFIFO, &span);
+
+  // Stop the interrupt once there is nothing left to send
+  if (count == 0)
+  {
+    UART_C2_REG(uart) &= ~UART_C2_TIE_MASK;
+    return;
+  }
+
+  if (count > room)
+    count = room;
+
+  for (uint16_t i = 0; i < count; i++)
+    UART_D_REG(uart) = (i < span.length1) ? span.data1[i] : span.data2[i - span.length1];
+
+  FIFO_Consume(&port->txFIFO, count);
+}
+
+// private function to make the bytes written by the receive DMA visible, called only by the reader
+static void SyncRxDMA(TUARTPort* const port)
+{
+  TFIFO* const fifo = &port->rxFIFO;
+  uint16_t size     = FIFO_Size(fifo);
+  uint16_t half     = size / 2;
+  uint16_t laps     = port->rxHalfLaps;
+  uint16_t offset   = (uint16_t)((uint32_t)DMA_DADDR_REG(DMA_BASE_PTR, port->rxChannel) - (uint32_t)port->rxBuffer);
+  uint16_t written, count;
+  uint32_t stamp    = Cycles_Get();
+  TFIFOSpan span;
+
+  // The DMA may have crossed into the next half of the buffer before its interrupt has counted it
+  // (its interrupt must never be held off for half a buffer, or a lap would go uncounted)
+  if (((offset / half) & 1) != (laps & 1))
+    laps++;
+
+  // The free-running index of the next byte the DMA will write, in step with Start and End
+  written = (uint16_t)(laps * half + (offset & (half - 1)));
+
+  // The DMA does not wait for the reader, so bytes it has gone round and written over are skipped rather than passed on
+  if ((uint16_t)(written - fifo->Start) > size)
+  {
+    uint16_t start = written - size;
+
+    fifo->Stats.nbOverflows += (uint16_t)(start - fifo->Start);
+
+    if ((int16_t)(fifo->End - start) < 0)
+      fifo->End = start;
+
+    fifo->Start = start;
+  }
+
+  count = written - fifo->End;
+
+  if (count == 0)
+    return;
+
+  for (uint16_t i = 0; i < count; i++)
+    port->rxStamps[(uint16_t)(fifo->End + i) & fifo->Mask] = stamp;
+
+  // The DMA has already written the bytes, so reserving only moves End
+  (void)FIFO_Reserve(fifo, count, &span);
+  FIFO_Commit(fifo, count);
+}
+
+// private function to start sending the next contiguous run of the transmit FIFO by DMA if none is being sent
+static void StartTxDMA(TUARTPort* const port)
+{
+  DMA_MemMapPtr dma = DMA_BASE_PTR;
+  uint8_t channel = port->txChannel;
+  TFIFOSpan span;
+  uint16_t length;
+
+  if ((port->txDMALength != 0) || (FIFO_Peek(&port->txFIFO, &span) == 0))
+    return;
+
+  length = (span.length1 < DMA_MAX_ITERATIONS) ? span.length1 : DMA_MAX_ITERATIONS;
+
+  // One byte per request from the run to D, and stop taking requests at the end so the ISR can start the next
+  DMA_SADDR_REG(dma, channel)         = (uint32_t)span.data1;
+  DMA_SOFF_REG(dma, channel)          = 1;
+  DMA_SLAST_REG(dma, channel)         = 0;
+  DMA_DADDR_REG(dma, channel)         = (uint32_t)&UART_D_REG(port->uart);
+  DMA_DOFF_REG(dma, channel)          = 0;
+  DMA_DLAST_SGA_REG(dma, channel)     = 0;
+  DMA_ATTR_REG(dma, channel)          = DMA_ATTR_SSIZE(0) | DMA_ATTR_DSIZE(0);
+  DMA_NBYTES_MLNO_REG(dma, channel)   = 1;
+  DMA_CITER_ELINKNO_REG(dma, channel) = length;
+  DMA_BITER_ELINKNO_REG(dma, channel) = length;
+  DMA_CSR_REG(dma, channel)           = DMA_CSR_INTMAJOR_MASK | DMA_CSR_DREQ_MASK;
+
+  port->txDMALength = length;
+  DMA_SERQ = channel;
+}
+
+// private function to handle the DMA channels of a port that have finished or reached a marker
+static void ServiceDMA(TUARTPort* const port, const uint32_t requests)
+{
+  // The receive DMA's interrupts only count its way round the buffer, for SyncRxDMA
+  if ((port->dmaMode & UART_DMA_RX) && (requests & (1 << port->rxChannel)))
+  {
+    DMA_CINT = port->rxChannel;
+    port->rxHalfLaps++;
+  }
+
+  if ((port->dmaMode & UART_DMA_TX) && (requests & (1 << port->txChannel)))
+  {
+    DMA_CINT = port->txChannel;
+    FIFO_Consume(&port->txFIFO, port->txDMALength);
+    port->txDMALength = 0;
+    StartTxDMA(port);
+  }
+}
+
+// private function to get the transmit side going after bytes have been added to the transmit FIFO
+static void StartTx(TUARTPort* const port)
+{
+  // The DMA ISR also starts transfers, and the UART ISR changes ILIE in C2, so neither can be let in part way through
+  EnterCritical();
+
+  if (port->dmaMode & UART_DMA_TX)
+    StartTxDMA(port);
+  else
+    UART_C2_REG(port->uart) |= UART_C2_TIE_MASK;
+
+  ExitCritical();
+}
+
+// private function to do the work of a UART's interrupt
+static void Service(TUARTPort* const port)
+{
+  UART_MemMapPtr uart = port->uart;
+  uint8_t status = UART_S1_REG(uart); // reading S1 is the first half of clearing its flags
+  bool idle = (UART_C2_REG(uart) & UART_C2_ILIE_MASK) && (status & UART_S1_IDLE_MASK);
+
+  // With DMA, RDRF and TDRE are requests to the DMA channels instead.
+  // Reading D clears RDRF once the hardware FIFO is below the watermark, and IDLE.
+  if (!(port->dmaMode & UART_DMA_RX) && (idle || ((UART_C2_REG(uart) & UART_C2_RIE_MASK) && (status & UART_S1_RDRF_MASK))))
+    DrainRx(port);
+
+  // Writing D clears TDRE once the hardware FIFO is above the watermark
+  if (!(port->dmaMode & UART_DMA_TX) && (UART_C2_REG(uart) & UART_C2_TIE_MASK) && (status & UART_S1_TDRE_MASK))
+    FillTx(port);
+}
+
+
+
+/*! @brief Sets up a UART before first use.
+ *
+ *  @param port The UART to set up.
+ *  @param baudRate The desired baud rate in bits/sec.
+ *  @param moduleClk The module clock rate of the UART in Hz.
+ *  @return bool - TRUE if the UART was successfully initialized.
+ */
+bool UART_PortInit(TUARTPort* const port, const uint32_t baudRate, const uint32_t moduleClk)
+{
+  UART_MemMapPtr uart = port->uart;
+  uint16_t sbr;
+  uint8_t brfa;
+
+  if (baudRate == 0)
+    return false;
+
+  // baud rate = module clock / (16 * (SBR + BRFA / 32)), see K70 manual pg 1937
+  sbr  = (uint16_t)(moduleClk / (16 * baudRate));
+  brfa = (uint8_t)(((moduleClk * 2) / baudRate) - (sbr * 32));
+
+  if ((sbr == 0) || (sbr > 0x1FFF))
+    return false;
+
+  if (!FIFO_Init(&port->rxFIFO, port->rxBuffer, port->rxSize) ||
+      !FIFO_Init(&port->txFIFO, port->txBuffer, port->txSize))
+    return false;
+
+  // Enable clock gates for the UART and PORTE
+  SIM_SCGC4 |= port->clockGate;
+  SIM_SCGC5 |= SIM_SCGC5_PORTE_MASK;
+
+  // Both UARTs have their TX and RX pins on ALT3
+  *port->txPCR = PORT_PCR_MUX(3);
+  *port->rxPCR = PORT_PCR_MUX(3);
+
+  // Back to interrupts for every byte until UART_PortEnableDMA is called again
+  if (port->dmaMode != 0)
+  {
+    DMA_CERQ = port->rxChannel;
+    DMA_CERQ = port->txChannel;
+    UART_C5_REG(uart) &= ~(UART_C5_RDMAS_MASK | UART_C5_TDMAS_MASK);
+    UART_C2_REG(uart) &= ~UART_C2_TIE_MASK;
+    port->dmaMode     = 0;
+    port->txDMALength = 0;
+  }
+
+  // The transmitter and receiver must be off while the baud rate is changed
+  UART_C2_REG(uart) &= ~(UART_C2_TE_MASK | UART_C2_RE_MASK);
+
+  UART_BDH_REG(uart) = UART_BDH_SBR(sbr >> 8);
+  UART_BDL_REG(uart) = UART_BDL_SBR(sbr);
+  UART_C4_REG(uart)  = (UART_C4_REG(uart) & ~UART_C4_BRFA_MASK) | UART_C4_BRFA(brfa);
+
+  // The hardware FIFOs can also only be turned on while the transmitter and receiver are off
+  UART_PFIFO_REG(uart) |= UART_PFIFO_TXFE_MASK | UART_PFIFO_RXFE_MASK;
+  UART_CFIFO_REG(uart) |= UART_CFIFO_TXFLUSH_MASK | UART_CFIFO_RXFLUSH_MASK;
+  port->rxDepth = HardwareDepth((UART_PFIFO_REG(uart) & UART_PFIFO_RXFIFOSIZE_MASK) >> UART_PFIFO_RXFIFOSIZE_SHIFT);
+  port->txDepth = HardwareDepth((UART_PFIFO_REG(uart) & UART_PFIFO_TXFIFOSIZE_MASK) >> UART_PFIFO_TXFIFOSIZE_SHIFT);
+  UART_RWFIFO_REG(uart) = RxWatermark(port);
+  UART_TWFIFO_REG(uart) = (port->txDepth > UART_TX_LOW_WATER) ? UART_TX_LOW_WATER : 0;
+
+  // Idle is counted from the stop bit, so a gap of one character marks the end of a burst
+  UART_C1_REG(uart) |= UART_C1_ILT_MASK;
+
+  UART_C2_REG(uart) |= UART_C2_TE_MASK | UART_C2_RE_MASK | UART_C2_RIE_MASK | UART_C2_ILIE_MASK;
+
+  // Setting up NVIC for the UART status interrupt, see K70 manual pg 97
+  // UART1: Vector=63, IRQ=47, UART2: Vector=65, IRQ=49
+  // Clear any pending interrupts on the UART
+  NVIC_ICPR_REG(NVIC_BASE_PTR, port->irq / 32) = (1 << (port->irq % 32));
+  // Enable interrupts from the UART module
+  NVIC_ISER_REG(NVIC_BASE_PTR, port->irq / 32) = (1 << (port->irq % 32));
+
+  return true;
+}
+
+
+
+/*! @brief Get a character from a receive FIFO if it is not empty.
+ *
+ *  @param port The UART to read from.
+ *  @param dataPtr A pointer to memory to store the retrieved byte.
+ *  @return bool - TRUE if the receive FIFO returned a character.
+ *  @note Assumes that UART_PortInit has been called.
+ */
+bool UART_PortInChar(TUARTPort* const port, uint8_t* const dataPtr)
+{
+  uint16_t position;
+
+  if (port->dmaMode & UART_DMA_RX)
+    SyncRxDMA(port);
+
+  position = port->rxFIFO.Start & port->rxFIFO.Mask;
+
+  if (!FIFO_Get(&port->rxFIFO, dataPtr))
+    return false;
+
+  port->inStamp = port->rxStamps[position];
+  return true;
+}
+
+
+
+/*! @brief Describes the bytes waiting in a receive FIFO so that they can be parsed in place.
+ *
+ *  @param port The UART.
+ *  @param span A pointer to where the waiting bytes are described.
+ *  @return uint16_t - The number of bytes in span.
+ *  @note The bytes stay in the FIFO until UART_PortInConsume is called.
+ */
+uint16_t UART_PortInPeek(TUARTPort* const port, TFIFOSpan* const span)
+{
+  if (port->dmaMode & UART_DMA_RX)
+    SyncRxDMA(port);
+
+  return FIFO_Peek(&port->rxFIFO, span);
+}
+
+
+
+/*! @brief Removes the oldest bytes from a receive FIFO once they have been parsed in place.
+ *
+ *  @param port The UART.
+ *  @param nbBytes The number of bytes parsed, no more than UART_PortInPeek returned.
+ *  @note UART_PortInStamp then gives when the last of them arrived.
+ */
+void UART_PortInConsume(TUARTPort* const port, const uint16_t nbBytes)
+{
+  if (nbBytes == 0)
+    return;
+
+  port->inStamp = port->rxStamps[(uint16_t)(port->rxFIFO.Start + nbBytes - 1) & port->rxFIFO.Mask];
+  FIFO_Consume(&port->rxFIFO, nbBytes);
+}
+
+
+
+/*! @brief Gets the number of bytes waiting in a receive FIFO.
+ *
+ *  @param port The UART.
+ *  @return uint16_t - The number of received bytes not yet read by UART_PortInChar.
+ */
+uint16_t UART_PortInCount(TUARTPort* const port)
+{
+  if (port->dmaMode & UART_DMA_RX)
+    SyncRxDMA(port);
+
+  return FIFO_Count(&port->rxFIFO);
+}
+
+
+
+/*! @brief Gets when the byte most recently returned by UART_PortInChar arrived.
+ *
+ *  @param port The UART.
+ *  @return uint32_t - The value of Cycles_Get when the byte was received.
+ */
+uint32_t UART_PortInStamp(const TUARTPort* const port)
+{
+  return port->inStamp;
+}
+
+
+
+/*! @brief Gets the number of received bytes thrown away because the receive FIFO was full.
+ *
+ *  @param port The UART.
+ *  @return uint32_t - The number of bytes lost since UART_PortInit or UART_PortResetStats.
+ */
+uint32_t UART_PortInDropped(const TUARTPort* const port)
+{
+  return port->rxFIFO.Stats.nbOverflows;
+}
+
+
+
+/*! @brief Gets the usage statistics of a UART's FIFOs.
+ *
+ *  @param port The UART.
+ *  @param rx Where the statistics of the receive FIFO are copied.
+ *  @param tx Where the statistics of the transmit FIFO are copied.
+ */
+void UART_PortGetStats(const TUARTPort* const port, TFIFOStats* const rx, TFIFOStats* const tx)
+{
+  *rx = port->rxFIFO.Stats;
+  *tx = port->txFIFO.Stats;
+}
+
+
+
+/*! @brief Clears the usage statistics of a UART's FIFOs.
+ *
+ *  @param port The UART.
+ */
+void UART_PortResetStats(TUARTPort* const port)
+{
+  FIFO_ResetStats(&port->rxFIFO);
+  FIFO_ResetStats(&port->txFIFO);
+}
+
+
+
+/*! @brief Gets the number of bytes waiting to be sent.
+ *
+ *  @param port The UART.
+ *  @return uint16_t - The number of bytes in the transmit FIFO.
+ */
+uint16_t UART_PortOutCount(const TUARTPort* const port)
+{
+  return FIFO_Count(&port->txFIFO);
+}
+
+
+
+/*! @brief Gets the number of bytes that can still be put in a transmit FIFO.
+ *
+ *  @param port The UART.
+ *  @return uint16_t - The free space in the transmit FIFO.
+ */
+uint16_t UART_PortOutSpace(const TUARTPort* const port)
+{
+  return FIFO_Size(&port->txFIFO) - FIFO_Count(&port->txFIFO);
+}
+
+
+
+/*! @brief Put a byte in a transmit FIFO if it is not full.
+ *
+ *  @param port The UART to send on.
+ *  @param data The byte to be placed in the transmit FIFO.
+ *  @return bool - TRUE if the data was placed in the transmit FIFO.
+ *  @note Assumes that UART_PortInit has been called.
+ */
+bool UART_PortOutChar(TUARTPort* const port, const uint8_t data)
+{
+  if (!FIFO_Put(&port->txFIFO, data))
+    return false;
+
+  StartTx(port);
+  return true;
+}
+
+
+
+/*! @brief Reserves space in a transmit FIFO so that bytes can be written straight into it.
+ *
+ *  @param port The UART to send on.
+ *  @param nbBytes The number of bytes to reserve.
+ *  @param span A pointer to where the reserved space is described.
+ *  @return bool - TRUE if the transmit FIFO had room for nbBytes.
+ *  @note Other writers to the transmit FIFO must be stopped until UART_PortOutCommit is called.
+ */
+bool UART_PortOutReserve(TUARTPort* const port, const uint16_t nbBytes, TFIFOSpan* const span)
+{
+  return FIFO_Reserve(&port->txFIFO, nbBytes, span);
+}
+
+
+
+/*! @brief Sends the first bytes of the space reserved by UART_PortOutReserve.
+ *
+ *  @param port The UART to send on.
+ *  @param nbBytes The number of bytes that were written.
+ *  @note Assumes that UART_PortOutReserve has been called.
+ */
+void UART_PortOutCommit(TUARTPort* const port, const uint16_t nbBytes)
+{
+  if (nbBytes == 0)
+    return;
+
+  FIFO_Commit(&port->txFIFO, nbBytes);
+  StartTx(port);
+}
+
+
+
+/*! @brief Poll a UART's status register to try and receive and/or transmit one character.
+ *
+ *  @param port The UART to poll.
+ *  @note Assumes that UART_PortInit has been called. Directions using DMA are left to the DMA.
+ */
+void UART_PortPoll(TUARTPort* const port)
+{
+  // RDRF and TDRE follow the watermarks, so the hardware FIFO counts are checked instead
+  if (!(port->dmaMode & UART_DMA_RX) && (UART_RCFIFO_REG(port->uart) > 0))
+    ReceiveByte(port, UART_D_REG(port->uart));
+
+  if (!(port->dmaMode & UART_DMA_TX) && (UART_TCFIFO_REG(port->uart) < port->txDepth) && (FIFO_Count(&port->txFIFO) > 0))
+    (void)FIFO_Get(&port->txFIFO, (uint8_t*)&UART_D_REG(port->uart));
+}
+
+
+
+/*! @brief Moves a UART's receiving and/or transmitting over to DMA.
+ *
+ *  @param port The UART.
+ *  @param mode UART_DMA_RX and/or UART_DMA_TX, for the directions to add.
+ *  @return bool - TRUE if the DMA was set up, FALSE if the receive buffer can not be used as a circular buffer.
+ *  @note Assumes that UART_PortInit has been called and interrupts are disabled. UART_PortInit goes back to interrupts.
+ */
+bool UART_PortEnableDMA(TUARTPort* const port, const uint8_t mode)
+{
+  DMA_MemMapPtr dma = DMA_BASE_PTR;
+  UART_MemMapPtr uart = port->uart;
+  uint8_t channel;
+  uint8_t log2Size = 0;
+
+  if (mode & ~(UART_DMA_RX | UART_DMA_TX))
+    return false;
+
+  // The destination modulo needs the buffer aligned to its size, and one pass around it must fit in a major loop
+  if ((mode & UART_DMA_RX) &&
+      (((uint32_t)port->rxBuffer & port->rxFIFO.Mask) || (port->rxSize > DMA_MAX_ITERATIONS)))
+    return false;
+
+  // Enable clock gates for the DMA and its request multiplexer
+  SIM_SCGC6 |= SIM_SCGC6_DMAMUX0_MASK;
+  SIM_SCGC7 |= SIM_SCGC7_DMA_MASK;
+
+  if ((mode & UART_DMA_RX) && !(port->dmaMode & UART_DMA_RX))
+  {
+    channel = port->rxChannel;
+
+    while ((1u << log2Size) < port->rxSize)
+      log2Size++;
+
+    // Start again empty, so the DMA's position in the buffer and the FIFO's indices begin in step
+    (void)FIFO_Init(&port->rxFIFO, port->rxBuffer, port->rxSize);
+    port->rxHalfLaps = 0;
+
+    // Runs forever from D into the buffer, with interrupts at the half and full points to count the laps
+    DMA_SADDR_REG(dma, channel)         = (uint32_t)&UART_D_REG(uart);
+    DMA_SOFF_REG(dma, channel)          = 0;
+    DMA_SLAST_REG(dma, channel)         = 0;
+    DMA_DADDR_REG(dma, channel)         = (uint32_t)port->rxBuffer;
+    DMA_DOFF_REG(dma, channel)          = 1;
+    DMA_DLAST_SGA_REG(dma, channel)     = 0;
+    DMA_ATTR_REG(dma, channel)          = DMA_ATTR_SSIZE(0) | DMA_ATTR_DSIZE(0) | DMA_ATTR_DMOD(log2Size);
+    DMA_NBYTES_MLNO_REG(dma, channel)   = 1;
+    DMA_CITER_ELINKNO_REG(dma, channel) = port->rxSize;
+    DMA_BITER_ELINKNO_REG(dma, channel) = port->rxSize;
+    DMA_CSR_REG(dma, channel)           = DMA_CSR_INTHALF_MASK | DMA_CSR_INTMAJOR_MASK;
+
+    DMAMUX_CHCFG_REG(DMAMUX0_BASE_PTR, channel) = 0;
+    DMAMUX_CHCFG_REG(DMAMUX0_BASE_PTR, channel) = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(port->rxSource);
+    DMA_SERQ = channel;
+
+    // Every byte goes to the DMA as it arrives, and the reader picks the bytes up from the DMA's position,
+    // so the idle line interrupt is not needed (clearing IDLE would mean reading D, racing the DMA for a byte)
+    UART_RWFIFO_REG(uart) = 1;
+    UART_C5_REG(uart) |= UART_C5_RDMAS_MASK;
+    UART_C2_REG(uart) &= ~UART_C2_ILIE_MASK;
+
+    // Clear any pending interrupts on the DMA channel and enable them
+    NVIC_ICPR_REG(NVIC_BASE_PTR, channel / 32) = (1 << (channel % 32));
+    NVIC_ISER_REG(NVIC_BASE_PTR, channel / 32) = (1 << (channel % 32));
+  }
+
+  if ((mode & UART_DMA_TX) && !(port->dmaMode & UART_DMA_TX))
+  {
+    channel = port->txChannel;
+
+    // Requests are only taken once StartTxDMA has a run to send
+    DMA_CERQ = channel;
+    DMAMUX_CHCFG_REG(DMAMUX0_BASE_PTR, channel) = 0;
+    DMAMUX_CHCFG_REG(DMAMUX0_BASE_PTR, channel) = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(port->txSource);
+
+    // Wait for the byte the interrupt may be sending to go, then TDRE asks the DMA for each byte instead
+    while (!(UART_S1_REG(uart) & UART_S1_TDRE_MASK));
+    UART_C5_REG(uart) |= UART_C5_TDMAS_MASK;
+    UART_C2_REG(uart) |= UART_C2_TIE_MASK;
+
+    NVIC_ICPR_REG(NVIC_BASE_PTR, channel / 32) = (1 << (channel % 32));
+    NVIC_ISER_REG(NVIC_BASE_PTR, channel / 32) = (1 << (channel % 32));
+  }
+
+  port->dmaMode |= mode;
+
+  // Send whatever was left waiting by the interrupt
+  if (port->dmaMode & UART_DMA_TX)
+    StartTxDMA(port);
+
+  return true;
+}
+
+
+
+/*! @brief Sets up the UART interface before first use.
+ *
+ *  @param baudRate The desired baud rate in bits/sec.
+ *  @param moduleClk The module clock rate in Hz.
+ *  @return bool - TRUE if the UART was successfully initialized.
+ */
+bool UART_Init(const uint32_t baudRate, const uint32_t moduleClk)
+{
+  return UART_PortInit(&UART_Port2, baudRate, moduleClk);
+}
+
+
+
+/*! @brief Get a character from the receive FIFO if it is not empty.
+ *
+ *  @param dataPtr A pointer to memory to store the retrieved byte.
+ *  @return bool - TRUE if the receive FIFO returned a character.
+ *  @note Assumes that UART_Init has been called.
+ */
+bool UART_InChar(uint8_t* const dataPtr)
+{
+  return UART_PortInChar(&UART_Port2, dataPtr);
+}
+
+
+
+/*! @brief Gets when the byte most recently returned by UART_InChar arrived.
+ *
+ *  @return uint32_t - The value of Cycles_Get when the byte was received.
+ *  @note Assumes that UART_InChar has returned a byte.
+ */
+uint32_t UART_InStamp(void)
+{
+  return UART_PortInStamp(&UART_Port2);
+}
+
+
+
+/*! @brief Gets the number of bytes waiting to be sent.
+ *
+ *  @return uint16_t - The number of bytes in the transmit FIFO.
+ *  @note Assumes that UART_Init has been called.
+ */
+uint16_t UART_OutCount(void)
+{
+  return UART_PortOutCount(&UART_Port2);
+}
+
+
+
+/*! @brief Gets the number of bytes waiting in the receive FIFO.
+ *
+ *  @return uint16_t - The number of received bytes not yet read by UART_InChar.
+ *  @note Assumes that UART_Init has been called.
+ */
+uint16_t UART_InCount(void)
+{
+  return UART_PortInCount(&UART_Port2);
+}
+
+
+
+/*! @brief Put a byte in the transmit FIFO if it is not full.
+ *
+ *  @param data The byte to be placed in the transmit FIFO.
+ *  @return bool - TRUE if the data was placed in the transmit FIFO.
+ *  @note Assumes that UART_Init has been called.
+ */
+bool UART_OutChar(const uint8_t data)
+{
+  return UART_PortOutChar(&UART_Port2, data);
+}
+
+
+
+/*! @brief Reserves space in the transmit FIFO so that bytes can be written straight into it.
+ *
+ *  @param nbBytes The number of bytes to reserve.
+ *  @param span A pointer to where the reserved space is described.
+ *  @return bool - TRUE if the transmit FIFO had room for nbBytes.
+ *  @note Other writers to the transmit FIFO must be stopped until UART_OutCommit is called.
+ */
+bool UART_OutReserve(const uint16_t nbBytes, TFIFOSpan* const span)
+{
+  return UART_PortOutReserve(&UART_Port2, nbBytes, span);
+}
+
+
+
+/*! @brief Sends the first bytes of the space reserved by UART_OutReserve.
+ *
+ *  @param nbBytes The number of bytes that were written.
+ *  @note Assumes that UART_OutReserve has been called.
+ */
+void UART_OutCommit(const uint16_t nbBytes)
+{
+  UART_PortOutCommit(&UART_Port2, nbBytes);
+}
+
+
+
+/*! @brief Poll the UART status register to try and receive and/or transmit one character.
+ *
+ *  @return void
+ *  @note Assumes that UART_Init has been called.
+ */
+void UART_Poll(void)
+{
+  UART_PortPoll(&UART_Port2);
+}
+
+
+
+/*! @brief Interrupt service routine for the UART.
+ *
+ *  @note Assumes the transmit and receive FIFOs have been initialized.
+ */
+void __attribute__ ((interrupt)) UART_ISR(void)
+{
+  Service(&UART_Port2);
+}
+
+
+
+/*! @brief Interrupt service routine for UART1.
+ *
+ *  @note Assumes UART_PortInit has been called for UART_Port1.
+ */
+void __attribute__ ((interrupt)) UART1_ISR(void)
+{
+  Service(&UART_Port1);
+}
+
+
+
+/*! @brief Interrupt service routine for the DMA channels of both UARTs.
+ *
+ *  @note Shared by the vectors of channels 0 to 3.
+ */
+void __attribute__ ((interrupt)) UART_DMA_ISR(void)
+{
+  uint32_t requests = DMA_INT;
+
+  ServiceDMA(&UART_Port1, requests);
+  ServiceDMA(&UART_Port2, requests);
+}
+
+/*!
+** @}
+*/
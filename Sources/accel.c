@@ -62,18 +62,6 @@ static union
 
 #define ADDRESS_CTRL_REG1 0x2A
 
-typedef enum
-{
-  DATE_RATE_800_HZ,
-  DATE_RATE_400_HZ,
-  DATE_RATE_200_HZ,
-  DATE_RATE_100_HZ,
-  DATE_RATE_50_HZ,
-  DATE_RATE_12_5_HZ,
-  DATE_RATE_6_25_HZ,
-  DATE_RATE_1_56_HZ
-} TOutputDataRate;
-
 typedef enum
 {
   SLEEP_MODE_RATE_50_HZ,
@@ -289,6 +277,24 @@ void Accel_SetMode(const TAccelMode mode)
 
 
 
+/*! @brief Set the output data rate of the accelerometer.
+ *  @param rate specifies the rate at which new XYZ data is made ready.
+ *
+ *  DR[2:0] can only be changed in STANDBY mode, so the accelerometer is taken out of ACTIVE
+ *  mode while CTRL_REG1 is rewritten and then reactivated.
+ */
+void Accel_SetRate(const TOutputDataRate rate)
+{
+  CTRL_REG1_ACTIVE = 0;
+  I2C_Write(ADDRESS_CTRL_REG1, CTRL_REG1); // enter STANDBY mode
+
+  CTRL_REG1_DR     = rate;
+  CTRL_REG1_ACTIVE = 1;
+  I2C_Write(ADDRESS_CTRL_REG1, CTRL_REG1); // new rate and back into ACTIVE mode
+}
+
+
+
 /*! @brief Interrupt service routine for the accelerometer.
  *
  *  The accelerometer has data ready.
@@ -20,6 +20,18 @@ typedef enum
   ACCEL_INT
 } TAccelMode;
 
+typedef enum
+{
+  DATE_RATE_800_HZ,
+  DATE_RATE_400_HZ,
+  DATE_RATE_200_HZ,
+  DATE_RATE_100_HZ,
+  DATE_RATE_50_HZ,
+  DATE_RATE_12_5_HZ,
+  DATE_RATE_6_25_HZ,
+  DATE_RATE_1_56_HZ
+} TOutputDataRate;
+
 typedef struct
 {
   uint32_t moduleClk;				/*!< The module clock rate in Hz. */
@@ -43,6 +55,15 @@ typedef union
 
 #pragma pack(pop)
 
+/*!
+ * @struct TAccelSample
+ */
+typedef struct
+{
+  TAccelData data;				/*!< The X, Y and Z accelerations. */
+  uint32_t stamp;				/*!< When the data was read, from Cycles_Get. */
+} TAccelSample;
+
 
 /*! @brief Initializes the accelerometer by calling the initialization routines of the supporting software modules.
  *
@@ -61,6 +82,11 @@ void Accel_ReadXYZ(uint8_t data[3]);
  */
 void Accel_SetMode(const TAccelMode mode);
 
+/*! @brief Set the output data rate of the accelerometer.
+ *  @param rate specifies the rate at which new XYZ data is made ready.
+ */
+void Accel_SetRate(const TOutputDataRate rate);
+
 /*! @brief Interrupt service routine for the accelerometer.
  *
  *  The accelerometer has data ready.
@@ -0,0 +1,186 @@
+/*! @file
+ *
+ *  @brief Coalesced acknowledgements.
+ *
+ *  This contains the functions for collecting the results of the packets that asked for an ACK,
+ *  and reporting them together as a cumulative ACK with a bitmap of the ones that failed.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-25
+ */
+/*!
+**  @addtogroup main_module main module documentation
+**
+**  @author Thanit Tangson
+**  @{
+*/
+
+/*
+
+A report says that every packet up to and including sequence has been handled, and which of the
+last (up to) 16 of them failed. Packets that never arrived show up as gaps in the sequence numbers,
+so they are reported as failed along with the packets that were NAKed. The PC resends the failures,
+and if it has heard nothing for a while, everything since the last report.
+
+A result must never be pushed out of the bitmap before it has been reported, as the next report would
+then count it as handled. AckWindow_Fits tells when a gap would do that, so the waiting results can be
+reported first. A gap too long for even an empty bitmap is reported ACKWINDOW_MAX_SIZE packets at a time
+with AckWindow_PutGap, each as a report with every bit set. Only a step backwards in the sequence numbers
+is taken as the PC starting again from a new number.
+
+*/
+
+#include "ackwindow.h"
+
+// Reports are timed with the cycle counter
+#include "cycles.h"
+
+// CPU_CORE_CLK_HZ is needed to turn ms into cycles
+#include "Cpu.h"
+
+/*! @brief Sets how results are coalesced, dropping any that have not been reported.
+ *
+ *  @param window A pointer to the ACK window.
+ *  @param size The number of packets per report (1 to ACKWINDOW_MAX_SIZE), or 0 to not coalesce.
+ *  @param timeout The longest a result waits to be reported, in ms, or 0 for no limit.
+ *  @return bool - TRUE if the settings are valid.
+ *  @note The sequence numbers start again at 0.
+ */
+bool AckWindow_Init(TAckWindow* const window, const uint8_t size, const uint8_t timeout)
+{
+  if (size > ACKWINDOW_MAX_SIZE)
+    return false;
+
+  window->size         = size;
+  window->timeout      = timeout;
+  window->nextSequence = 0;
+  window->lastSequence = 0;
+  window->nbPending    = 0;
+  window->nakBitmap    = 0;
+  return true;
+}
+
+
+
+/*! @brief Checks whether the result of a packet can be added without pushing unreported results out of the bitmap.
+ *
+ *  @param window A pointer to the ACK window.
+ *  @param sequence The sequence number of the packet.
+ *  @return bool - TRUE if the result fits, FALSE if the waiting results or part of the gap must be reported first.
+ */
+bool AckWindow_Fits(const TAckWindow* const window, const uint8_t sequence)
+{
+  uint8_t missing = (uint8_t)(sequence - window->nextSequence);
+
+  if (missing >= 128) // a step backwards, which AckWindow_Put takes as a restart
+    return true;
+
+  return (window->nbPending + missing + 1 <= ACKWINDOW_MAX_SIZE);
+}
+
+
+
+/*! @brief Adds the result of a packet.
+ *
+ *  Sequence numbers skipped since the previous packet are counted as failed.
+ *  @param window A pointer to the ACK window.
+ *  @param sequence The sequence number of the packet.
+ *  @param success TRUE if the packet was handled successfully.
+ *  @return bool - TRUE if a report is due.
+ *  @note Assumes that AckWindow_Init has been called with a size. Unreported results are lost if AckWindow_Fits is FALSE.
+ */
+bool AckWindow_Put(TAckWindow* const window, const uint8_t sequence, const bool success)
+{
+  uint8_t missing = (uint8_t)(sequence - window->nextSequence);
+  uint16_t nbResults;
+
+  if (missing >= 128) // a step backwards means the PC has started counting again
+    missing = 0;
+
+  if (window->nbPending == 0)
+  {
+    window->firstStamp = Cycles_Get();
+    window->nakBitmap  = 0;
+  }
+
+  // Missing packets shift in as failures, and a long gap pushes the older results out of the bitmap
+  if (missing >= ACKWINDOW_MAX_SIZE)
+    window->nakBitmap = 0xFFFF;
+  else
+    window->nakBitmap = (uint16_t)((window->nakBitmap << missing) | ((1u << missing) - 1));
+
+  window->nakBitmap = (uint16_t)((window->nakBitmap << 1) | (success ? 0 : 1));
+
+  nbResults = window->nbPending + missing + 1;
+  window->nbPending    = (nbResults > ACKWINDOW_MAX_SIZE) ? ACKWINDOW_MAX_SIZE : (uint8_t)nbResults;
+  window->lastSequence = sequence;
+  window->nextSequence = sequence + 1;
+
+  return (window->nbPending >= window->size);
+}
+
+
+
+/*! @brief Adds the next ACKWINDOW_MAX_SIZE sequence numbers as packets that never arrived.
+ *
+ *  Used to report a gap that is too long for the bitmap, when AckWindow_Fits is FALSE with nothing pending.
+ *  @param window A pointer to the ACK window.
+ *  @note Assumes that the window is empty, so that no results are pushed out.
+ */
+void AckWindow_PutGap(TAckWindow* const window)
+{
+  window->firstStamp   = Cycles_Get();
+  window->nakBitmap    = 0xFFFF;
+  window->nbPending    = ACKWINDOW_MAX_SIZE;
+  window->lastSequence = window->nextSequence + ACKWINDOW_MAX_SIZE - 1;
+  window->nextSequence = window->nextSequence + ACKWINDOW_MAX_SIZE;
+}
+
+
+
+/*! @brief Checks whether the oldest unreported result has waited too long.
+ *
+ *  @param window A pointer to the ACK window.
+ *  @return bool - TRUE if a report is due.
+ */
+bool AckWindow_Due(const TAckWindow* const window)
+{
+  if ((window->nbPending == 0) || (window->timeout == 0))
+    return false;
+
+  return (Cycles_Get() - window->firstStamp >= window->timeout * (CPU_CORE_CLK_HZ / 1000));
+}
+
+
+
+/*! @brief Gets the results waiting in the window for a report, leaving them there until AckWindow_Clear.
+ *
+ *  @param window A pointer to the ACK window.
+ *  @param sequence Where the sequence number of the newest result is stored.
+ *  @param nakBitmap Where the bitmap of failed packets is stored (bit 0 for sequence, bit 1 for the one before, ...).
+ *  @return bool - TRUE if there were results to report.
+ */
+bool AckWindow_Peek(const TAckWindow* const window, uint8_t* const sequence, uint16_t* const nakBitmap)
+{
+  if (window->nbPending == 0)
+    return false;
+
+  *sequence  = window->lastSequence;
+  *nakBitmap = window->nakBitmap;
+  return true;
+}
+
+
+
+/*! @brief Empties the window once its results have been reported.
+ *
+ *  @param window A pointer to the ACK window.
+ */
+void AckWindow_Clear(TAckWindow* const window)
+{
+  window->nbPending = 0;
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,94 @@
+/*! @file
+ *
+ *  @brief Coalesced acknowledgements.
+ *
+ *  This contains the functions for collecting the results of the packets that asked for an ACK,
+ *  and reporting them together as a cumulative ACK with a bitmap of the ones that failed.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-25
+ */
+
+#ifndef ACKWINDOW_H
+#define ACKWINDOW_H
+
+// New types
+#include "types.h"
+
+// Most packets one report can cover, one bit each
+#define ACKWINDOW_MAX_SIZE 16
+
+/*!
+ * @struct TAckWindow
+ */
+typedef struct
+{
+  uint8_t size;			/*!< Packets per report, 0 if ACKs are not coalesced */
+  uint8_t timeout;		/*!< Longest a result waits to be reported, in ms (0 for no limit) */
+  uint8_t nextSequence;		/*!< The sequence number expected next */
+  uint8_t lastSequence;		/*!< The sequence number of the newest result */
+  uint8_t nbPending;		/*!< The number of results not yet reported */
+  uint16_t nakBitmap;		/*!< Bit i is set if packet lastSequence - i failed or never arrived */
+  uint32_t firstStamp;		/*!< When the oldest unreported result was added, in cycles */
+} TAckWindow;
+
+/*! @brief Sets how results are coalesced, dropping any that have not been reported.
+ *
+ *  @param window A pointer to the ACK window.
+ *  @param size The number of packets per report (1 to ACKWINDOW_MAX_SIZE), or 0 to not coalesce.
+ *  @param timeout The longest a result waits to be reported, in ms, or 0 for no limit.
+ *  @return bool - TRUE if the settings are valid.
+ *  @note The sequence numbers start again at 0.
+ */
+bool AckWindow_Init(TAckWindow* const window, const uint8_t size, const uint8_t timeout);
+
+/*! @brief Checks whether the result of a packet can be added without pushing unreported results out of the bitmap.
+ *
+ *  @param window A pointer to the ACK window.
+ *  @param sequence The sequence number of the packet.
+ *  @return bool - TRUE if the result fits, FALSE if the waiting results or part of the gap must be reported first.
+ */
+bool AckWindow_Fits(const TAckWindow* const window, const uint8_t sequence);
+
+/*! @brief Adds the result of a packet.
+ *
+ *  Sequence numbers skipped since the previous packet are counted as failed.
+ *  @param window A pointer to the ACK window.
+ *  @param sequence The sequence number of the packet.
+ *  @param success TRUE if the packet was handled successfully.
+ *  @return bool - TRUE if a report is due.
+ *  @note Assumes that AckWindow_Init has been called with a size. Unreported results are lost if AckWindow_Fits is FALSE.
+ */
+bool AckWindow_Put(TAckWindow* const window, const uint8_t sequence, const bool success);
+
+/*! @brief Adds the next ACKWINDOW_MAX_SIZE sequence numbers as packets that never arrived.
+ *
+ *  Used to report a gap that is too long for the bitmap, when AckWindow_Fits is FALSE with nothing pending.
+ *  @param window A pointer to the ACK window.
+ *  @note Assumes that the window is empty, so that no results are pushed out.
+ */
+void AckWindow_PutGap(TAckWindow* const window);
+
+/*! @brief Checks whether the oldest unreported result has waited too long.
+ *
+ *  @param window A pointer to the ACK window.
+ *  @return bool - TRUE if a report is due.
+ */
+bool AckWindow_Due(const TAckWindow* const window);
+
+/*! @brief Gets the results waiting in the window for a report, leaving them there until AckWindow_Clear.
+ *
+ *  @param window A pointer to the ACK window.
+ *  @param sequence Where the sequence number of the newest result is stored.
+ *  @param nakBitmap Where the bitmap of failed packets is stored (bit 0 for sequence, bit 1 for the one before, ...).
+ *  @return bool - TRUE if there were results to report.
+ */
+bool AckWindow_Peek(const TAckWindow* const window, uint8_t* const sequence, uint16_t* const nakBitmap);
+
+/*! @brief Empties the window once its results have been reported.
+ *
+ *  @param window A pointer to the ACK window.
+ */
+void AckWindow_Clear(TAckWindow* const window);
+
+#endif
@@ -0,0 +1,205 @@
+/*! @file biquad.c
+ *
+ *  @brief Fixed-point biquad IIR filter.
+ *
+ *  This contains the functions for running a cascade of Q15 second order (biquad) IIR sections
+ *  over blocks of samples, e.g. as an anti-aliasing low-pass before decimating accelerometer data.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-16
+ */
+/*!
+**  @addtogroup main_module main module documentation
+**
+**  @author Thanit Tangson
+**  @{
+*/
+
+/*
+
+Each stage is a direct form I section:
+  y[n] = b0*x[n] + b1*x[n-1] + b2*x[n-2] - a1*y[n-1] - a2*y[n-2]
+
+The history is kept packed two samples to a word so that the Cortex-M4 SMLALD instruction
+can do two 16x16 multiplies and the 64-bit accumulate in a single cycle.
+On any other target (e.g. a PC for testing) the same maths is done in plain C.
+
+*/
+
+#include "biquad.h"
+
+// Needed for the defintion of NULL pointer
+#include "PE_Types.h"
+
+const uint32_t BIQUAD_LOWPASS_FS16[BIQUAD_LOWPASS_FS16_NB_STAGES * BIQUAD_NB_COEFFS_PER_STAGE] =
+{
+  BIQUAD_STAGE(461, 921, 461, -22366, 7825),
+  BIQUAD_STAGE(544, 1088, 544, -26407, 12198)
+};
+
+const uint32_t BIQUAD_LOWPASS_FS8[BIQUAD_LOWPASS_FS8_NB_STAGES * BIQUAD_NB_COEFFS_PER_STAGE] =
+{
+  BIQUAD_STAGE(1451, 2903, 1451, -14015, 3436),
+  BIQUAD_STAGE(1888, 3777, 1888, -18236, 9405)
+};
+
+
+#if defined(__ARM_ARCH_7EM__)
+
+// Dual 16x16 multiply with 64-bit accumulate: acc += lo(a)*lo(b) + hi(a)*hi(b)
+static inline int64_t MAC2(const uint32_t a, const uint32_t b, int64_t acc)
+{
+  __asm__ ("smlald %Q0, %R0, %1, %2" : "+r" (acc) : "r" (a), "r" (b));
+  return acc;
+}
+
+// Saturates a value to 16 bits
+static inline int16_t Sat16(const int32_t value)
+{
+  int32_t result;
+  __asm__ ("ssat %0, #16, %1" : "=r" (result) : "r" (value));
+  return (int16_t)result;
+}
+
+#else
+
+// Dual 16x16 multiply with 64-bit accumulate: acc += lo(a)*lo(b) + hi(a)*hi(b)
+static inline int64_t MAC2(const uint32_t a, const uint32_t b, int64_t acc)
+{
+  acc += (int32_t)(int16_t)a * (int16_t)b;
+  acc += (int32_t)(int16_t)(a >> 16) * (int16_t)(b >> 16);
+  return acc;
+}
+
+// Saturates a value to 16 bits
+static inline int16_t Sat16(const int32_t value)
+{
+  if (value > INT16_MAX)
+    return INT16_MAX;
+  if (value < INT16_MIN)
+    return INT16_MIN;
+  return (int16_t)value;
+}
+
+#endif
+
+
+
+/*! @brief Sets up a biquad cascade before first use and clears its history.
+ *
+ *  @param filter A pointer to the filter to initialize.
+ *  @param nbStages The number of second order stages.
+ *  @param postShift The number of bits the coefficients were scaled down by.
+ *  @param coeffs The packed coefficients, BIQUAD_NB_COEFFS_PER_STAGE words per stage.
+ *  @param state Storage for the filter history, BIQUAD_NB_STATE_PER_STAGE words per stage.
+ *  @return bool - TRUE if the filter was successfully initialized.
+ */
+bool Biquad_Init(TBiquad* const filter, const uint8_t nbStages, const uint8_t postShift,
+                 const uint32_t* const coeffs, uint32_t* const state)
+{
+  // A post shift of 15 or more would leave no fractional bits in the coefficients
+  if ((coeffs == NULL) || (state == NULL) || (nbStages == 0) || (postShift > 14))
+    return false;
+
+  filter->nbStages  = nbStages;
+  filter->postShift = postShift;
+  filter->coeffs    = coeffs;
+  filter->state     = state;
+
+  Biquad_Reset(filter);
+
+  return true;
+}
+
+
+
+/*! @brief Clears the history of a biquad cascade.
+ *
+ *  @param filter A pointer to the filter to reset.
+ *  @note Assumes that Biquad_Init has been called.
+ */
+void Biquad_Reset(TBiquad* const filter)
+{
+  for (uint16_t i = 0; i < (uint16_t)filter->nbStages * BIQUAD_NB_STATE_PER_STAGE; i++)
+    filter->state[i] = 0;
+}
+
+
+
+/*! @brief Filters a block of Q15 samples through the whole cascade.
+ *
+ *  The filter history is carried across calls, so consecutive blocks form one continuous signal.
+ *  @param filter A pointer to the filter.
+ *  @param input The first input sample.
+ *  @param output The first output sample (may be the same as input).
+ *  @param nbSamples The number of samples to filter.
+ *  @param stride The distance between consecutive samples in both arrays (3 for interleaved XYZ data).
+ *  @note Assumes that Biquad_Init has been called.
+ */
+void Biquad_Filter(TBiquad* const filter, const int16_t* const input, int16_t* const output,
+                   const uint16_t nbSamples, const uint8_t stride)
+{
+  const uint32_t* coeffs = filter->coeffs;
+  uint32_t* state        = filter->state;
+  const uint8_t shift    = 15 - filter->postShift; // accumulator is Q(30 - postShift), output is Q15
+  const int16_t* src     = input;
+
+  // Run the whole block through one stage at a time so the coefficients and history stay in registers
+  for (uint8_t stage = 0; stage < filter->nbStages; stage++)
+  {
+    const int32_t b0   = (int16_t)coeffs[0];
+    const uint32_t b12 = coeffs[1];
+    const uint32_t a12 = coeffs[2];
+    uint32_t x12       = state[0];
+    uint32_t y12       = state[1];
+
+    const int16_t* in = src;
+    int16_t* out      = output;
+
+    for (uint16_t n = nbSamples; n > 0; n--)
+    {
+      const int16_t x0 = *in;
+      int64_t acc      = (int64_t)(b0 * x0);
+
+      acc = MAC2(b12, x12, acc);
+      acc = MAC2(a12, y12, acc);
+
+      const int16_t y0 = Sat16((int32_t)(acc >> shift));
+
+      // Shift the new samples into the history: x[n-2] <- x[n-1], x[n-1] <- x[n]
+      x12 = (x12 << 16) | (uint16_t)x0;
+      y12 = (y12 << 16) | (uint16_t)y0;
+
+      *out = y0;
+      in  += stride;
+      out += stride;
+    }
+
+    state[0] = x12;
+    state[1] = y12;
+
+    coeffs += BIQUAD_NB_COEFFS_PER_STAGE;
+    state  += BIQUAD_NB_STATE_PER_STAGE;
+    src     = output; // later stages work in place on the previous stage's output
+  }
+}
+
+
+
+/*! @brief Filters a block of interleaved XYZ Q15 samples, one cascade per axis.
+ *
+ *  @param filters An array of 3 filters, one each for X, Y and Z.
+ *  @param input nbSamples interleaved {x, y, z} samples.
+ *  @param output nbSamples interleaved {x, y, z} filtered samples (may be the same as input).
+ *  @param nbSamples The number of XYZ samples to filter.
+ *  @note Assumes that Biquad_Init has been called for each filter.
+ */
+void Biquad_FilterXYZ(TBiquad filters[3], const int16_t* const input, int16_t* const output, const uint16_t nbSamples)
+{
+  for (uint8_t axis = 0; axis < 3; axis++)
+    Biquad_Filter(&filters[axis], input + axis, output + axis, nbSamples, 3);
+}
+
+/*!
+** @}
+*/
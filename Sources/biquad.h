@@ -0,0 +1,92 @@
+/*! @file
+ *
+ *  @brief Fixed-point biquad IIR filter.
+ *
+ *  This contains the functions for running a cascade of Q15 second order (biquad) IIR sections
+ *  over blocks of samples, e.g. as an anti-aliasing low-pass before decimating accelerometer data.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-16
+ */
+
+#ifndef BIQUAD_H
+#define BIQUAD_H
+
+// New types
+#include "types.h"
+
+// Number of coefficient words and state words used by each second order stage
+#define BIQUAD_NB_COEFFS_PER_STAGE 3
+#define BIQUAD_NB_STATE_PER_STAGE  2
+
+// Packs two signed 16-bit values into one word (lo in bits 0-15, hi in bits 16-31) as used by SMLALD
+#define BIQUAD_PAIR(lo, hi) ((uint32_t)(uint16_t)(int16_t)(lo) | ((uint32_t)(uint16_t)(int16_t)(hi) << 16))
+
+/*! Builds the 3 coefficient words of a stage: {b0}, {b1:b2}, {-a1:-a2}.
+ *  The feedback coefficients are negated so that every term is accumulated. */
+#define BIQUAD_STAGE(b0, b1, b2, a1, a2) BIQUAD_PAIR((b0), 0), BIQUAD_PAIR((b1), (b2)), BIQUAD_PAIR(-(a1), -(a2))
+
+/*!
+ * @struct TBiquad
+ */
+typedef struct
+{
+  uint8_t nbStages;		/*!< The number of second order stages in the cascade */
+  uint8_t postShift;		/*!< The coefficients are stored divided by 2^postShift so that they fit in Q15 */
+  const uint32_t* coeffs;	/*!< BIQUAD_NB_COEFFS_PER_STAGE packed coefficient words per stage */
+  uint32_t* state;		/*!< BIQUAD_NB_STATE_PER_STAGE packed words per stage: {x[n-1]:x[n-2]}, {y[n-1]:y[n-2]} */
+} TBiquad;
+
+// 4th order Butterworth low-pass, cutoff at fs/16 (e.g. 50 Hz at 800 Hz), Q14 coefficients (postShift = 1)
+#define BIQUAD_LOWPASS_FS16_NB_STAGES  2
+#define BIQUAD_LOWPASS_FS16_POST_SHIFT 1
+extern const uint32_t BIQUAD_LOWPASS_FS16[BIQUAD_LOWPASS_FS16_NB_STAGES * BIQUAD_NB_COEFFS_PER_STAGE];
+
+// 4th order Butterworth low-pass, cutoff at fs/8 (e.g. 50 Hz at 400 Hz), Q14 coefficients (postShift = 1)
+#define BIQUAD_LOWPASS_FS8_NB_STAGES  2
+#define BIQUAD_LOWPASS_FS8_POST_SHIFT 1
+extern const uint32_t BIQUAD_LOWPASS_FS8[BIQUAD_LOWPASS_FS8_NB_STAGES * BIQUAD_NB_COEFFS_PER_STAGE];
+
+/*! @brief Sets up a biquad cascade before first use and clears its history.
+ *
+ *  @param filter A pointer to the filter to initialize.
+ *  @param nbStages The number of second order stages.
+ *  @param postShift The number of bits the coefficients were scaled down by.
+ *  @param coeffs The packed coefficients, BIQUAD_NB_COEFFS_PER_STAGE words per stage.
+ *  @param state Storage for the filter history, BIQUAD_NB_STATE_PER_STAGE words per stage.
+ *  @return bool - TRUE if the filter was successfully initialized.
+ */
+bool Biquad_Init(TBiquad* const filter, const uint8_t nbStages, const uint8_t postShift,
+                 const uint32_t* const coeffs, uint32_t* const state);
+
+/*! @brief Clears the history of a biquad cascade.
+ *
+ *  @param filter A pointer to the filter to reset.
+ *  @note Assumes that Biquad_Init has been called.
+ */
+void Biquad_Reset(TBiquad* const filter);
+
+/*! @brief Filters a block of Q15 samples through the whole cascade.
+ *
+ *  The filter history is carried across calls, so consecutive blocks form one continuous signal.
+ *  @param filter A pointer to the filter.
+ *  @param input The first input sample.
+ *  @param output The first output sample (may be the same as input).
+ *  @param nbSamples The number of samples to filter.
+ *  @param stride The distance between consecutive samples in both arrays (3 for interleaved XYZ data).
+ *  @note Assumes that Biquad_Init has been called.
+ */
+void Biquad_Filter(TBiquad* const filter, const int16_t* const input, int16_t* const output,
+                   const uint16_t nbSamples, const uint8_t stride);
+
+/*! @brief Filters a block of interleaved XYZ Q15 samples, one cascade per axis.
+ *
+ *  @param filters An array of 3 filters, one each for X, Y and Z.
+ *  @param input nbSamples interleaved {x, y, z} samples.
+ *  @param output nbSamples interleaved {x, y, z} filtered samples (may be the same as input).
+ *  @param nbSamples The number of XYZ samples to filter.
+ *  @note Assumes that Biquad_Init has been called for each filter.
+ */
+void Biquad_FilterXYZ(TBiquad filters[3], const int16_t* const input, int16_t* const output, const uint16_t nbSamples);
+
+#endif
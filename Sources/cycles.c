@@ -0,0 +1,69 @@
+/*! @file cycles.c
+ *
+ *  @brief Free running cycle counter.
+ *
+ *  This contains the functions for timestamping and benchmarking code using the Cortex-M4 DWT cycle counter.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-19
+ */
+/*!
+**  @addtogroup main_module main module documentation
+**
+**  @author Thanit Tangson
+**  @{
+*/
+
+#include "cycles.h"
+
+#if defined(__arm__)
+
+// K70 module registers
+#include "MK70F12.h"
+
+#define DEMCR_TRCENA_MASK       (1UL << 24)	/*!< Enables the DWT and ITM units. */
+#define DWT_CTRL_CYCCNTENA_MASK (1UL << 0)	/*!< Enables the cycle counter. */
+
+/*! @brief Starts the cycle counter.
+ *
+ *  @return bool - TRUE if the cycle counter was successfully started.
+ */
+bool Cycles_Init(void)
+{
+  DEMCR     |= DEMCR_TRCENA_MASK;
+  DWT_CYCCNT = 0;
+  DWT_CTRL  |= DWT_CTRL_CYCCNTENA_MASK;
+
+  return true;
+}
+
+/*! @brief Reads the cycle counter.
+ *
+ *  @return uint32_t - The number of core clock cycles counted so far.
+ *  @note Assumes that Cycles_Init has been called.
+ */
+uint32_t Cycles_Get(void)
+{
+  return DWT_CYCCNT;
+}
+
+#else
+
+// When built on a PC the processor clock ticks are used instead, which is enough to compare code
+#include <time.h>
+
+bool Cycles_Init(void)
+{
+  return true;
+}
+
+uint32_t Cycles_Get(void)
+{
+  return (uint32_t)clock();
+}
+
+#endif
+
+/*!
+** @}
+*/
@@ -0,0 +1,32 @@
+/*! @file
+ *
+ *  @brief Free running cycle counter.
+ *
+ *  This contains the functions for timestamping and benchmarking code using the Cortex-M4 DWT cycle counter.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-19
+ */
+
+#ifndef CYCLES_H
+#define CYCLES_H
+
+// New types
+#include "types.h"
+
+/*! @brief Starts the cycle counter.
+ *
+ *  @return bool - TRUE if the cycle counter was successfully started.
+ */
+bool Cycles_Init(void);
+
+/*! @brief Reads the cycle counter.
+ *
+ *  The counter runs at the core clock and wraps around every 2^32 cycles,
+ *  so differences between two readings are always correct when taken as a uint32_t.
+ *  @return uint32_t - The number of core clock cycles counted so far.
+ *  @note Assumes that Cycles_Init has been called.
+ */
+uint32_t Cycles_Get(void);
+
+#endif
@@ -0,0 +1,260 @@
+/*! @file decimate.c
+ *
+ *  @brief Oversample-and-decimate filter for accelerometer data.
+ *
+ *  This contains the functions for reducing XYZ data acquired at a high output data rate
+ *  down to a lower reporting rate by averaging, CIC filtering or low-pass filtering.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-17
+ */
+/*!
+**  @addtogroup main_module main module documentation
+**
+**  @author Thanit Tangson
+**  @{
+*/
+
+/*
+
+The accelerometer data is 8-bit two's complement, so each byte is treated as an int8_t.
+Averaging and the CIC use unsigned accumulators on purpose: the integrators are allowed to
+wrap around, and the comb differences still come out right as long as the final result fits.
+A 2nd order CIC has a DC gain of factor^2, which is removed by shifting right 2*log2(factor).
+
+The low-pass mode only has two fixed filters, with cutoffs at fs/16 and fs/8 of their input rate, so it
+decimates in stages. Each stage of fs/16 low-pass and keeping every 4th sample brings the rate down by 4
+with the cutoff at half the new Nyquist frequency, and a last stage of fs/8 low-pass keeps every 2nd
+sample for odd powers of 2. Every stage filters at a quarter of the rate of the one before, so the
+later stages cost little.
+
+*/
+
+#include "decimate.h"
+
+// private function to return log2 of a power of 2, or 0xFF if the value is not a power of 2
+static uint8_t Log2(const uint8_t value)
+{
+  for (uint8_t bit = 0; bit < 8; bit++)
+    if (value == (1 << bit))
+      return bit;
+
+  return 0xFF;
+}
+
+// private function to clamp a result back into the range of the accelerometer data
+static uint8_t Clamp8(const int32_t value)
+{
+  if (value > INT8_MAX)
+    return (uint8_t)INT8_MAX;
+  if (value < INT8_MIN)
+    return (uint8_t)INT8_MIN;
+  return (uint8_t)(int8_t)value;
+}
+
+
+// private function to add a low-pass stage, with the cutoff at half the new Nyquist frequency when decimating by 4
+static void AddStage(TDecimator* const decimator, const uint8_t factor)
+{
+  uint8_t stage = decimator->nbStages++;
+
+  decimator->stageFactor[stage] = factor;
+  decimator->stageCount[stage]  = 0;
+
+  for (uint8_t axis = 0; axis < 3; axis++)
+    if (factor == 4)
+      (void)Biquad_Init(&decimator->lowpass[stage][axis], BIQUAD_LOWPASS_FS16_NB_STAGES, BIQUAD_LOWPASS_FS16_POST_SHIFT,
+                        BIQUAD_LOWPASS_FS16, decimator->lowpassState[stage][axis]);
+    else
+      (void)Biquad_Init(&decimator->lowpass[stage][axis], BIQUAD_LOWPASS_FS8_NB_STAGES, BIQUAD_LOWPASS_FS8_POST_SHIFT,
+                        BIQUAD_LOWPASS_FS8, decimator->lowpassState[stage][axis]);
+}
+
+
+
+/*! @brief Sets up the decimator before first use.
+ *
+ *  @param decimator A pointer to the decimator to initialize.
+ *  @param mode The decimation method to use.
+ *  @param factor The number of input samples per output sample, a power of 2 from 1 to DECIMATE_MAX_FACTOR.
+ *  @return bool - TRUE if the decimator was successfully initialized.
+ */
+bool Decimate_Init(TDecimator* const decimator, const TDecimateMode mode, const uint8_t factor)
+{
+  uint8_t log2Factor = Log2(factor);
+
+  if ((log2Factor == 0xFF) || (factor > DECIMATE_MAX_FACTOR) || (mode > DECIMATE_LOWPASS))
+    return false;
+
+  decimator->mode       = mode;
+  decimator->factor     = factor;
+  decimator->log2Factor = log2Factor;
+  decimator->count      = 0;
+
+  for (uint8_t axis = 0; axis < 3; axis++)
+  {
+    decimator->integrator1[axis] = 0;
+    decimator->integrator2[axis] = 0;
+    decimator->comb1[axis]       = 0;
+    decimator->comb2[axis]       = 0;
+  }
+
+  // Stages of 4 while they fit, then one of 2 (or 1, so that factor 1 is still filtered)
+  decimator->nbStages = 0;
+
+  for (; log2Factor >= 2; log2Factor -= 2)
+    AddStage(decimator, 4);
+
+  if ((log2Factor == 1) || (decimator->nbStages == 0))
+    AddStage(decimator, (uint8_t)(1 << log2Factor));
+
+  return true;
+}
+
+
+
+/*! @brief Feeds one XYZ sample into the decimator.
+ *
+ *  @param decimator A pointer to the decimator.
+ *  @param input The newest sample from the accelerometer.
+ *  @param output A pointer to where the decimated sample is stored when one is ready.
+ *  @return bool - TRUE if a new decimated sample was written to output.
+ *  @note Assumes that Decimate_Init has been called.
+ */
+bool Decimate_Put(TDecimator* const decimator, const TAccelData* const input, TAccelData* const output)
+{
+  return (Decimate_PutBlock(decimator, input, output, 1) == 1);
+}
+
+
+
+/*! @brief Feeds a block of XYZ samples into the decimator.
+ *
+ *  @param decimator A pointer to the decimator.
+ *  @param input nbSamples samples from the accelerometer, oldest first.
+ *  @param output Where the decimated samples are stored, room for nbSamples / factor + 1 samples is needed.
+ *  @param nbSamples The number of input samples.
+ *  @return uint16_t - The number of decimated samples written to output.
+ *  @note Assumes that Decimate_Init has been called.
+ */
+uint16_t Decimate_PutBlock(TDecimator* const decimator, const TAccelData* const input, TAccelData* const output,
+                           const uint16_t nbSamples)
+{
+  int16_t lowpassData[DECIMATE_BLOCK_SIZE * 3];
+  uint16_t nbOutputs = 0;
+  uint8_t count      = decimator->count;
+  const uint8_t factor = decimator->factor;
+
+  switch (decimator->mode)
+  {
+    case DECIMATE_AVERAGE:
+      // One pass per axis so the running sum stays in a register for the whole block
+      for (uint8_t axis = 0; axis < 3; axis++)
+      {
+        uint32_t sum = decimator->integrator1[axis];
+        count        = decimator->count;
+        nbOutputs    = 0;
+
+        for (uint16_t n = 0; n < nbSamples; n++)
+        {
+          sum += (uint32_t)(int32_t)(int8_t)input[n].bytes[axis];
+
+          if (++count >= factor)
+          {
+            output[nbOutputs++].bytes[axis] = Clamp8((int32_t)sum >> decimator->log2Factor);
+            sum   = 0;
+            count = 0;
+          }
+        }
+
+        decimator->integrator1[axis] = sum;
+      }
+      break;
+
+    case DECIMATE_CIC:
+      for (uint8_t axis = 0; axis < 3; axis++)
+      {
+        uint32_t integrator1 = decimator->integrator1[axis];
+        uint32_t integrator2 = decimator->integrator2[axis];
+        count                = decimator->count;
+        nbOutputs            = 0;
+
+        for (uint16_t n = 0; n < nbSamples; n++)
+        {
+          // Integrators run at the input rate
+          integrator1 += (uint32_t)(int32_t)(int8_t)input[n].bytes[axis];
+          integrator2 += integrator1;
+
+          // Combs run at the output rate
+          if (++count >= factor)
+          {
+            uint32_t stage1 = integrator2 - decimator->comb1[axis];
+            decimator->comb1[axis] = integrator2;
+
+            uint32_t stage2 = stage1 - decimator->comb2[axis];
+            decimator->comb2[axis] = stage1;
+
+            output[nbOutputs++].bytes[axis] = Clamp8((int32_t)stage2 >> (2 * decimator->log2Factor));
+            count = 0;
+          }
+        }
+
+        decimator->integrator1[axis] = integrator1;
+        decimator->integrator2[axis] = integrator2;
+      }
+      break;
+
+    case DECIMATE_LOWPASS:
+      // The filter must see every sample, even those that are thrown away, so filter in chunks
+      for (uint16_t start = 0; start < nbSamples; start += DECIMATE_BLOCK_SIZE)
+      {
+        uint16_t nbChunk = nbSamples - start;
+        if (nbChunk > DECIMATE_BLOCK_SIZE)
+          nbChunk = DECIMATE_BLOCK_SIZE;
+
+        for (uint16_t n = 0; n < nbChunk; n++)
+          for (uint8_t axis = 0; axis < 3; axis++)
+            lowpassData[3 * n + axis] = (int16_t)((int8_t)input[start + n].bytes[axis] * 256); // Q7 -> Q15
+
+        // Each stage filters what the one before kept, packing the samples it keeps to the front
+        for (uint8_t stage = 0; stage < decimator->nbStages; stage++)
+        {
+          uint16_t nbKept = 0;
+
+          Biquad_FilterXYZ(decimator->lowpass[stage], lowpassData, lowpassData, nbChunk);
+
+          for (uint16_t n = 0; n < nbChunk; n++)
+            if (++decimator->stageCount[stage] >= decimator->stageFactor[stage])
+            {
+              for (uint8_t axis = 0; axis < 3; axis++)
+                lowpassData[3 * nbKept + axis] = lowpassData[3 * n + axis];
+              nbKept++;
+              decimator->stageCount[stage] = 0;
+            }
+
+          nbChunk = nbKept;
+        }
+
+        for (uint16_t n = 0; n < nbChunk; n++)
+        {
+          for (uint8_t axis = 0; axis < 3; axis++)
+            output[nbOutputs].bytes[axis] = Clamp8((lowpassData[3 * n + axis] + 128) >> 8); // Q15 -> Q7, rounded
+          nbOutputs++;
+        }
+      }
+      break;
+
+    case DECIMATE_OFF:
+    default:
+      for (uint16_t n = 0; n < nbSamples; n++)
+        output[n] = input[n];
+      return nbSamples;
+  }
+
+  decimator->count = count;
+  return nbOutputs;
+}
+
+/*!
+** @}
+*/
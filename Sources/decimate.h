@@ -0,0 +1,92 @@
+/*! @file
+ *
+ *  @brief Oversample-and-decimate filter for accelerometer data.
+ *
+ *  This contains the functions for reducing XYZ data acquired at a high output data rate
+ *  down to a lower reporting rate by averaging, CIC filtering or low-pass filtering.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-17
+ */
+
+#ifndef DECIMATE_H
+#define DECIMATE_H
+
+// New types
+#include "types.h"
+
+// Accelerometer data type
+#include "accel.h"
+
+// Biquad low-pass used as the anti-aliasing filter in DECIMATE_LOWPASS mode
+#include "biquad.h"
+
+// Largest decimation factor allowed (must be a power of 2)
+#define DECIMATE_MAX_FACTOR 128
+
+// Number of samples low-pass filtered at a time by Decimate_PutBlock
+#define DECIMATE_BLOCK_SIZE 32
+
+// Most low-pass stages, each decimating by 4 except possibly the last (enough for DECIMATE_MAX_FACTOR)
+#define DECIMATE_MAX_STAGES 4
+
+typedef enum
+{
+  DECIMATE_OFF,			/*!< Every sample is passed straight through. */
+  DECIMATE_AVERAGE,		/*!< Each output is the mean of the last factor samples. */
+  DECIMATE_CIC,			/*!< 2nd order cascaded integrator-comb filter. */
+  DECIMATE_LOWPASS		/*!< Stages of biquad low-pass followed by keeping every 4th (or 2nd) sample. */
+} TDecimateMode;
+
+/*!
+ * @struct TDecimator
+ */
+typedef struct
+{
+  TDecimateMode mode;		/*!< The decimation method in use */
+  uint8_t factor;		/*!< The number of input samples per output sample */
+  uint8_t log2Factor;		/*!< log2(factor), used to normalise the accumulated samples */
+  uint8_t count;		/*!< The number of input samples since the last output */
+  uint32_t integrator1[3];	/*!< Average sum or first CIC integrator, per axis */
+  uint32_t integrator2[3];	/*!< Second CIC integrator, per axis */
+  uint32_t comb1[3];		/*!< First CIC comb delay, per axis */
+  uint32_t comb2[3];		/*!< Second CIC comb delay, per axis */
+  uint8_t nbStages;		/*!< The number of low-pass stages in use */
+  uint8_t stageFactor[DECIMATE_MAX_STAGES];	/*!< The decimation factor of each low-pass stage */
+  uint8_t stageCount[DECIMATE_MAX_STAGES];	/*!< The number of input samples since each stage's last output */
+  TBiquad lowpass[DECIMATE_MAX_STAGES][3];	/*!< Anti-aliasing filters, per stage and axis */
+  uint32_t lowpassState[DECIMATE_MAX_STAGES][3][2 * BIQUAD_NB_STATE_PER_STAGE]; /*!< Anti-aliasing filter history, per stage and axis */
+} TDecimator;
+
+/*! @brief Sets up the decimator before first use.
+ *
+ *  @param decimator A pointer to the decimator to initialize.
+ *  @param mode The decimation method to use.
+ *  @param factor The number of input samples per output sample, a power of 2 from 1 to DECIMATE_MAX_FACTOR.
+ *  @return bool - TRUE if the decimator was successfully initialized.
+ */
+bool Decimate_Init(TDecimator* const decimator, const TDecimateMode mode, const uint8_t factor);
+
+/*! @brief Feeds one XYZ sample into the decimator.
+ *
+ *  @param decimator A pointer to the decimator.
+ *  @param input The newest sample from the accelerometer.
+ *  @param output A pointer to where the decimated sample is stored when one is ready.
+ *  @return bool - TRUE if a new decimated sample was written to output.
+ *  @note Assumes that Decimate_Init has been called.
+ */
+bool Decimate_Put(TDecimator* const decimator, const TAccelData* const input, TAccelData* const output);
+
+/*! @brief Feeds a block of XYZ samples into the decimator.
+ *
+ *  @param decimator A pointer to the decimator.
+ *  @param input nbSamples samples from the accelerometer, oldest first.
+ *  @param output Where the decimated samples are stored, room for nbSamples / factor + 1 samples is needed.
+ *  @param nbSamples The number of input samples.
+ *  @return uint16_t - The number of decimated samples written to output.
+ *  @note Assumes that Decimate_Init has been called.
+ */
+uint16_t Decimate_PutBlock(TDecimator* const decimator, const TAccelData* const input, TAccelData* const output,
+                           const uint16_t nbSamples);
+
+#endif
@@ -0,0 +1,201 @@
+/*! @file
+ *
+ *  @brief Delta compression of accelerometer data.
+ *
+ *  This contains the functions for packing XYZ samples into frames of zig-zag encoded
+ *  differences from the previous sample, 4 bits per axis when the signal changes slowly.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-23
+ */
+/*!
+**  @addtogroup main_module main module documentation
+**
+**  @author Thanit Tangson
+**  @{
+*/
+
+/*
+
+A frame is:
+
+Byte 0    = sequence number, incremented for every frame so the PC can tell if one was lost
+Byte 1    = number of samples
+Bytes 2-4 = X, Y, Z of the first sample (the keyframe)
+Bytes 5-  = nibbles, high nibble first, for X, Y and Z of every later sample
+
+Each delta is the difference from the same axis of the previous sample, modulo 256, zig-zag encoded
+(0, -1, 1, -2, 2 ... -> 0, 1, 2, 3, 4 ...) so small changes either way give small numbers.
+Zig-zag values 0 to 14 take one nibble. Anything else is the escape nibble 0xF followed by the
+zig-zag value in two nibbles, high first. An odd number of nibbles is padded with 0.
+
+Every frame starts with a keyframe, so a lost frame only loses its own samples. At high data rates
+most deltas are a few LSBs, so samples take 1.5 bytes instead of 3.
+
+*/
+
+#include "delta.h"
+
+#define DELTA_ESCAPE 0x0F
+
+// private function to zig-zag encode a difference so small magnitudes of either sign are small numbers
+static uint8_t ZigZag(const uint8_t current, const uint8_t previous)
+{
+  // Shifted as unsigned, since shifting a negative int8_t left is undefined; the top bit is the sign
+  uint8_t delta = (uint8_t)(current - previous);
+  return (uint8_t)((uint8_t)(delta << 1) ^ (uint8_t)-(delta >> 7));
+}
+
+// private function to undo ZigZag
+static uint8_t UnZigZag(const uint8_t zigZag, const uint8_t previous)
+{
+  uint8_t delta = (zigZag >> 1) ^ (uint8_t)-(zigZag & 1);
+  return (uint8_t)(previous + delta);
+}
+
+// private function to add a nibble to the frame
+static void PutNibble(TDeltaEncoder* const encoder, const uint8_t nibble)
+{
+  uint8_t* byte = &encoder->frame[DELTA_HEADER_BYTES + encoder->nbNibbles / 2];
+
+  if (encoder->nbNibbles & 1)
+    *byte |= nibble;
+  else
+    *byte = nibble << 4;
+
+  encoder->nbNibbles++;
+}
+
+// private function to get a nibble of a frame
+static uint8_t GetNibble(const uint8_t* const frame, const uint16_t index)
+{
+  uint8_t byte = frame[DELTA_HEADER_BYTES + index / 2];
+  return (index & 1) ? (byte & 0x0F) : (byte >> 4);
+}
+
+
+
+/*! @brief Sets up a delta encoder before first use and starts a new frame.
+ *
+ *  @param encoder A pointer to the encoder to initialize.
+ *  @param samplesPerFrame The number of samples per frame, and so how often a keyframe is sent (1 to DELTA_MAX_SAMPLES).
+ *  @return bool - TRUE if the encoder was successfully initialized.
+ */
+bool Delta_Init(TDeltaEncoder* const encoder, const uint8_t samplesPerFrame)
+{
+  if ((samplesPerFrame == 0) || (samplesPerFrame > DELTA_MAX_SAMPLES))
+    return false;
+
+  encoder->samplesPerFrame = samplesPerFrame;
+  encoder->nbSamples       = 0;
+  encoder->nbNibbles       = 0;
+  encoder->sequence        = 0;
+  return true;
+}
+
+
+
+/*! @brief Adds a sample to the frame being filled.
+ *
+ *  @param encoder A pointer to the encoder.
+ *  @param data The accelerometer data to add.
+ *  @return uint8_t - The length of the frame in encoder->frame once it is full, otherwise 0.
+ *  @note Assumes that Delta_Init has been called. The next sample starts a new frame.
+ */
+uint8_t Delta_Put(TDeltaEncoder* const encoder, const TAccelData* const data)
+{
+  if (encoder->nbSamples == 0) // Start a new frame with a keyframe
+  {
+    encoder->frame[0]  = encoder->sequence;
+    encoder->frame[2]  = data->axes.x;
+    encoder->frame[3]  = data->axes.y;
+    encoder->frame[4]  = data->axes.z;
+    encoder->nbNibbles = 0;
+  }
+  else
+  {
+    for (uint8_t axis = 0; axis < 3; axis++)
+    {
+      uint8_t zigZag = ZigZag(data->bytes[axis], encoder->previous.bytes[axis]);
+
+      if (zigZag < DELTA_ESCAPE)
+        PutNibble(encoder, zigZag);
+      else
+      {
+        PutNibble(encoder, DELTA_ESCAPE);
+        PutNibble(encoder, zigZag >> 4);
+        PutNibble(encoder, zigZag & 0x0F);
+      }
+    }
+  }
+
+  encoder->previous = *data;
+  encoder->nbSamples++;
+
+  if (encoder->nbSamples < encoder->samplesPerFrame)
+    return 0;
+
+  encoder->frame[1] = encoder->nbSamples;
+  encoder->nbSamples = 0;
+  encoder->sequence++;
+  return (uint8_t)(DELTA_HEADER_BYTES + (encoder->nbNibbles + 1) / 2);
+}
+
+
+
+/*! @brief Unpacks a frame made by Delta_Put.
+ *
+ *  @param frame The frame.
+ *  @param length The number of bytes in the frame.
+ *  @param data Where the samples are stored (room for DELTA_MAX_SAMPLES).
+ *  @return uint8_t - The number of samples decoded, or 0 if the frame is invalid.
+ */
+uint8_t Delta_Decode(const uint8_t* const frame, const uint8_t length, TAccelData* const data)
+{
+  uint8_t nbSamples;
+  uint16_t nbNibbles;
+  uint16_t index = 0;
+
+  if (length < DELTA_HEADER_BYTES)
+    return 0;
+
+  nbSamples = frame[1];
+  nbNibbles = (length - DELTA_HEADER_BYTES) * 2;
+
+  if ((nbSamples == 0) || (nbSamples > DELTA_MAX_SAMPLES))
+    return 0;
+
+  data[0].axes.x = frame[2];
+  data[0].axes.y = frame[3];
+  data[0].axes.z = frame[4];
+
+  for (uint8_t sample = 1; sample < nbSamples; sample++)
+  {
+    for (uint8_t axis = 0; axis < 3; axis++)
+    {
+      uint8_t zigZag;
+
+      if (index >= nbNibbles)
+        return 0;
+
+      zigZag = GetNibble(frame, index++);
+
+      if (zigZag == DELTA_ESCAPE)
+      {
+        if (index + 2 > nbNibbles)
+          return 0;
+
+        zigZag = (GetNibble(frame, index) << 4) | GetNibble(frame, index + 1);
+        index += 2;
+      }
+
+      data[sample].bytes[axis] = UnZigZag(zigZag, data[sample - 1].bytes[axis]);
+    }
+  }
+
+  return nbSamples;
+}
+
+/*!
+** @}
+*/
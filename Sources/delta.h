@@ -0,0 +1,69 @@
+/*! @file
+ *
+ *  @brief Delta compression of accelerometer data.
+ *
+ *  This contains the functions for packing XYZ samples into frames of zig-zag encoded
+ *  differences from the previous sample, 4 bits per axis when the signal changes slowly.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-23
+ */
+
+#ifndef DELTA_H
+#define DELTA_H
+
+// New types
+#include "types.h"
+
+// Accelerometer data type
+#include "accel.h"
+
+// Most samples in a frame, so that even incompressible data fits in PACKET_FRAME_MAX_BYTES
+#define DELTA_MAX_SAMPLES 48
+
+// Sequence number, number of samples and the keyframe
+#define DELTA_HEADER_BYTES 5
+
+// Largest frame: every delta after the keyframe escaped, 3 nibbles per axis
+#define DELTA_MAX_FRAME_BYTES (DELTA_HEADER_BYTES + ((DELTA_MAX_SAMPLES - 1) * 9 + 1) / 2)
+
+/*!
+ * @struct TDeltaEncoder
+ */
+typedef struct
+{
+  uint8_t frame[DELTA_MAX_FRAME_BYTES];	/*!< The frame being filled */
+  uint16_t nbNibbles;			/*!< The number of nibbles written after the header */
+  uint8_t nbSamples;			/*!< The number of samples in the frame so far */
+  uint8_t samplesPerFrame;		/*!< The number of samples in a full frame */
+  uint8_t sequence;			/*!< The sequence number of the frame being filled */
+  TAccelData previous;			/*!< The last sample added, which the next delta is taken from */
+} TDeltaEncoder;
+
+/*! @brief Sets up a delta encoder before first use and starts a new frame.
+ *
+ *  @param encoder A pointer to the encoder to initialize.
+ *  @param samplesPerFrame The number of samples per frame, and so how often a keyframe is sent (1 to DELTA_MAX_SAMPLES).
+ *  @return bool - TRUE if the encoder was successfully initialized.
+ */
+bool Delta_Init(TDeltaEncoder* const encoder, const uint8_t samplesPerFrame);
+
+/*! @brief Adds a sample to the frame being filled.
+ *
+ *  @param encoder A pointer to the encoder.
+ *  @param data The accelerometer data to add.
+ *  @return uint8_t - The length of the frame in encoder->frame once it is full, otherwise 0.
+ *  @note Assumes that Delta_Init has been called. The next sample starts a new frame.
+ */
+uint8_t Delta_Put(TDeltaEncoder* const encoder, const TAccelData* const data);
+
+/*! @brief Unpacks a frame made by Delta_Put.
+ *
+ *  @param frame The frame.
+ *  @param length The number of bytes in the frame.
+ *  @param data Where the samples are stored (room for DELTA_MAX_SAMPLES).
+ *  @return uint8_t - The number of samples decoded, or 0 if the frame is invalid.
+ */
+uint8_t Delta_Decode(const uint8_t* const frame, const uint8_t length, TAccelData* const data);
+
+#endif
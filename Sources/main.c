@@ -41,6 +41,17 @@
 #include "RTC.h"
 #include "PIT.h"
 #include "FTM.h"
+#include "accel.h"
+#include "median.h"
+#include "decimate.h"
+#include "stats.h"
+#include "FFT.h"
+#include "cycles.h"
+#include "tilt.h"
+#include "delta.h"
+#include "stream.h"
+#include "ackwindow.h"
+#include "ring.h"
 #include "PE_Types.h"
 #include "PE_Error.h"
 #include "PE_Const.h"
@@ -57,6 +68,53 @@
 #define CMD_SETTIME   0x0C
 #define CMD_MODE      0x0A
 #define CMD_ACCEL     0x10
+#define CMD_ACCELRATE 0x11
+#define CMD_STATS     0x12
+#define CMD_SPECTRUM  0x13
+#define CMD_TILT      0x14
+#define CMD_ACCELBATCH 0x15
+#define CMD_FRAMING   0x16
+#define CMD_ACCELDELTA 0x17
+#define CMD_PING      0x18
+#define CMD_SUBSCRIBE 0x19
+#define CMD_ACKWINDOW 0x1A
+#define CMD_STREAMLINK 0x1B
+#define CMD_DIAGNOSTICS 0x1C
+
+// Accelerometer batch frames: sequence number and 32-bit timestamp, then up to ACCEL_BATCH_MAX XYZ samples
+#define ACCEL_BATCH_HEADER_BYTES 5
+#define ACCEL_BATCH_MAX          32
+
+// Accelerometer samples that can wait for the main loop, a power of 2
+#define ACCEL_QUEUE_SIZE 16
+
+// Ping reply frame: sequence number, 3 timestamps and the transmit FIFO depth
+#define PING_BYTES 16
+
+// Diagnostics frame: 5 queues of 5 counters, 3 dispatch counters and 2 links of 2 counters, all 32-bit
+#define DIAGNOSTICS_NB_QUEUES 5
+#define DIAGNOSTICS_BYTES     ((DIAGNOSTICS_NB_QUEUES * 5 + 3 + 2 * 2) * 4)
+
+// Items of a Subscribe status packet, sent in the low nibble of Parameter1
+#define STREAM_ITEM_CREDITS   0x00
+#define STREAM_ITEM_DROPPED   0x01
+#define STREAM_ITEM_DECIMATED 0x02
+
+// Items of a Statistics packet, sent in the low nibble of Parameter1
+#define STATS_ITEM_MEAN     0x00
+#define STATS_ITEM_VARIANCE 0x01
+#define STATS_ITEM_RMS      0x02
+#define STATS_ITEM_MINMAX   0x03
+
+// Number of bands the spectrum is summarised into, and Parameter1 flags of the Spectrum packets
+#define SPECTRUM_NB_BANDS       8
+#define SPECTRUM_BAND_FLAG      0x80
+#define SPECTRUM_HEADER_FLAG    0xC0
+#define SPECTRUM_BENCHMARK_FLAG 0xE0
+
+// Most packets handled, and most time spent handling them, in one pass of the main loop
+#define DISPATCH_MAX_PACKETS 8
+#define DISPATCH_MAX_CYCLES  (500 * (CPU_CORE_CLK_HZ / 1000000)) // 500 us
 
 // Global volatile variables
 
@@ -65,6 +123,51 @@ volatile uint16union_t *towerMode   = NULL;
 
 bool synchronousMode = true; // variable to track current I2C mode (synchronous by default)
 
+TOutputDataRate accelRate = DATE_RATE_1_56_HZ; // variable to track the accelerometer output data rate
+TDecimator accelDecimator;                     // decimates accelerometer data down to the reporting rate
+TMedianFilter3 accelMedian;                    // history of the last 2 accelerometer samples for median filtering
+TStats accelStats;                             // sliding window statistics of the median filtered accelerometer data
+bool statsPeriodic = false;                    // variable to track whether statistics are sent every second
+volatile bool secondElapsed = false;           // TRUE once RTCCallback has counted a second, for the main loop to report
+
+TComplex spectrumData[FFT_MAX_SIZE];           // accelerometer samples captured for, and then the result of, the FFT
+uint32_t spectrumPower[FFT_MAX_SIZE / 2 + 1];  // power in each bin of the spectrum
+uint8_t spectrumLog2Size;                      // log2 of the number of samples to capture
+uint8_t spectrumAxis;                          // axis being captured (0-2 for X, Y or Z)
+uint8_t spectrumNbPeaks;                       // number of peaks to report
+volatile uint16_t spectrumCount   = 0;         // number of samples captured so far
+volatile bool spectrumCapturing   = false;     // TRUE while ProcessAccelSample is filling spectrumData
+volatile bool spectrumReady       = false;     // TRUE once spectrumData is full and waiting for the main loop
+
+bool tiltStream = false;                       // variable to track whether tilt angles are sent instead of XYZ data
+TAccelData lastAccelData;                      // most recent filtered and decimated accelerometer data
+
+TAccelSample accelSample;                      // sample being read, started by AccelCallback
+TAccelSample accelQueueStorage[ACCEL_QUEUE_SIZE]; // samples read by AccelCallback waiting for the main loop
+TRing accelQueue;                              // the ring of samples in accelQueueStorage
+
+uint8_t accelBatchSize = 0;                    // samples per batch frame, 0 to send single-sample Accelerometer packets
+uint8_t accelBatchCount = 0;                   // samples in the batch being filled
+uint8_t accelBatchSequence = 0;                // sequence number of the batch being filled
+uint8_t accelBatch[ACCEL_BATCH_HEADER_BYTES + ACCEL_BATCH_MAX * 3]; // the batch frame data being filled
+
+TDeltaEncoder accelDelta;                      // packs accelerometer data into delta compressed frames
+bool deltaStream = false;                      // variable to track whether delta compressed frames are sent
+
+uint16_t dispatchMaxDepth = 0;                // most bytes seen waiting in the receive FIFO at the start of a pass
+uint32_t dispatchOverruns = 0;                 // passes that ran over DISPATCH_MAX_CYCLES
+uint32_t dispatchDeferred = 0;                 // passes that stopped at DISPATCH_MAX_PACKETS with more data waiting
+
+TStream accelStream;                           // the stream the PC has subscribed to, which replaces the streams above
+
+TAckWindow ackWindow;                          // results of the packets that asked for an ACK, when ACKs are coalesced
+
+TPacketLink dataLink;                          // the second serial link, on UART1, which only sends
+TPacketLink* streamLink = &Packet_ControlLink; // the link the accelerometer data and periodic statistics are sent on
+
+bool framingChange = false;                    // TRUE when the framing is to change once the current packet is handled
+TPacketFraming newFraming;                     // the framing to change to
+
 
 // Function Initializations
 
@@ -75,9 +178,10 @@ bool synchronousMode = true; // variable to track current I2C mode (synchronous
  *
  * Parameter1 = 0, Parameter2 = 0, Parameter3 = 0
  *
+ * @param packet The packet to handle (not used, so may be NULL when called at startup).
  * @return bool - TRUE if all of the packets were handled successfully.
  */
-bool HandleStartupPacket(void)
+bool HandleStartupPacket(const TPacket* const packet)
 {
   bool success;
 
@@ -121,9 +225,10 @@ bool HandleStartupPacket(void)
  * @brief Handles the tower version packet in accordance with the Tower Serial Communication Protocol document
  *
  * Parameter1 = 'v', Parameter2 = 1, Parameter3 = 0 (V1.0)
+ * @param packet The packet to handle.
  * @return bool - TRUE if the packet was handled successfully.
  */
-bool HandleVersionPacket(void)
+bool HandleVersionPacket(const TPacket* const packet)
 {
   return Packet_Put(CMD_VERSION, 'v', 0x01, 0x00);
 }
@@ -136,17 +241,18 @@ bool HandleVersionPacket(void)
  * Parameter1 = 0x01, Parameter2 = LSB, Parameter3 = MSB
  * If Parameter1 is 0x02, you are able to set LSB and MSB by passing these in through Parameter2 and Parameter3
  *
+ * @param packet The packet to handle.
  * @return bool - TRUE if the packet was handled successfully.
  */
-bool HandleNumberPacket(void)
+bool HandleNumberPacket(const TPacket* const packet)
 {
-  if (Packet_Parameter1 == 0x02) // If the packet is in SET mode, set the tower number by storing it in flash before returning the packet
+  if (PACKET_PARAMETER1(packet) == 0x02) // If the packet is in SET mode, set the tower number by storing it in flash before returning the packet
   {
-    bool success = Flash_Write16((uint16_t*)towerNumber, Packet_Parameter23);
+    bool success = Flash_Write16((uint16_t*)towerNumber, PACKET_PARAMETER23(packet));
 
     return Packet_Put(CMD_NUMBER, 0x01, towerNumber->s.Lo, towerNumber->s.Hi) && success;
   }
-  else if (Packet_Parameter1 == 0x01) // If the packet is in GET mode, just return the current tower number
+  else if (PACKET_PARAMETER1(packet) == 0x01) // If the packet is in GET mode, just return the current tower number
   {
     return Packet_Put(CMD_NUMBER, 0x01, towerNumber->s.Lo, towerNumber->s.Hi);
   }
@@ -163,16 +269,17 @@ bool HandleNumberPacket(void)
  * Parameter1 = 0x01, Parameter2 = LSB, Parameter3 = MSB
  * If Parameter1 is 0x02, you are able to set LSB and MSB by passing these in through Parameter2 and Parameter3
  *
+ * @param packet The packet to handle.
  * @return bool - TRUE if the packet was handled successfully.
  */
-bool HandleTowerModePacket(void)
+bool HandleTowerModePacket(const TPacket* const packet)
 {
-  if (Packet_Parameter1 == 0x02) // If the packet is in SET mode, set the tower mode by storing it in flash before returning the packet
+  if (PACKET_PARAMETER1(packet) == 0x02) // If the packet is in SET mode, set the tower mode by storing it in flash before returning the packet
   {
-    bool success = Flash_Write16((uint16_t*)towerMode, Packet_Parameter23);
+    bool success = Flash_Write16((uint16_t*)towerMode, PACKET_PARAMETER23(packet));
     return Packet_Put(CMD_TOWERMODE, 0x01, towerMode->s.Lo, towerMode->s.Hi) && success;
   }
-  else if (Packet_Parameter1 == 0x01) // If the packet is in GET mode, just return the current tower mode
+  else if (PACKET_PARAMETER1(packet) == 0x01) // If the packet is in GET mode, just return the current tower mode
     return Packet_Put(CMD_TOWERMODE, 0x01, towerMode->s.Lo, towerMode->s.Hi);
 
   // If the packet is not in either SET or GET mode, return false
@@ -187,19 +294,20 @@ bool HandleTowerModePacket(void)
  *
  * Parameter1 = address offset (0-7), Parameter2 = 0, Parameter3 = data
  *
+ * @param packet The packet to handle.
  * @return bool - TRUE if the packet was handled successfully.
  */
-bool HandleProgBytePacket(void)
+bool HandleProgBytePacket(const TPacket* const packet)
 {
   // Return false if the address is out of range
-  if ((Packet_Parameter1 < 0) || (Packet_Parameter1 > 8))
+  if ((PACKET_PARAMETER1(packet) < 0) || (PACKET_PARAMETER1(packet) > 8))
     return false;
 	  
-  if (Packet_Parameter1 == 0x08) // 0x08 erases the flash
+  if (PACKET_PARAMETER1(packet) == 0x08) // 0x08 erases the flash
     return Flash_Erase();
 	  
   // Writes the data in parameter3 to the given address starting at FLASH_DATA_START and offsetted according to Parameter1
-  return Flash_Write8((uint8_t *)(FLASH_DATA_START + Packet_Parameter1), Packet_Parameter3);
+  return Flash_Write8((uint8_t *)(FLASH_DATA_START + PACKET_PARAMETER1(packet)), PACKET_PARAMETER3(packet));
 }
 
 
@@ -210,16 +318,17 @@ bool HandleProgBytePacket(void)
  *
  * Parameter1 = address offset (0-7), Parameter2 = 0, Parameter3 = 0
  *
+ * @param packet The packet to handle.
  * @return bool - TRUE if the packet was handled successfully.
  */
-bool HandleReadBytePacket(void)
+bool HandleReadBytePacket(const TPacket* const packet)
 {
   // Return false if the address is out of range
-  if ((Packet_Parameter1 < 0) || (Packet_Parameter1 > 7))
+  if ((PACKET_PARAMETER1(packet) < 0) || (PACKET_PARAMETER1(packet) > 7))
     return false;
 
   // Data is accessed using a Flash.h macro by starting at address FLASH_DATA_START and offsetting according to Parameter1
-  return (Packet_Put(CMD_READBYTE, Packet_Parameter1, 0x00, _FB(FLASH_DATA_START + Packet_Parameter1)));
+  return (Packet_Put(CMD_READBYTE, PACKET_PARAMETER1(packet), 0x00, _FB(FLASH_DATA_START + PACKET_PARAMETER1(packet))));
 }
 
   
@@ -230,17 +339,18 @@ bool HandleReadBytePacket(void)
  *
  * Parameter1 = hours(0-23), Parameter2 = minutes(0-59), Parameter3 = seconds (0-59)
  *
+ * @param packet The packet to handle.
  * @return bool - TRUE if the packet was handled successfully, FALSE if parameters out of range.
  */
-bool HandleSetTimePacket(void)
+bool HandleSetTimePacket(const TPacket* const packet)
 {
   // Return false if any time values are out of range
-  if ((Packet_Parameter1 < 0) || (Packet_Parameter1 > 23) ||
-      (Packet_Parameter2 < 0) || (Packet_Parameter2 > 59) ||
-      (Packet_Parameter3 < 0) || (Packet_Parameter3 > 59))
+  if ((PACKET_PARAMETER1(packet) < 0) || (PACKET_PARAMETER1(packet) > 23) ||
+      (PACKET_PARAMETER2(packet) < 0) || (PACKET_PARAMETER2(packet) > 59) ||
+      (PACKET_PARAMETER3(packet) < 0) || (PACKET_PARAMETER3(packet) > 59))
     return false;
     
-  RTC_Set(Packet_Parameter1, Packet_Parameter2, Packet_Parameter3);
+  RTC_Set(PACKET_PARAMETER1(packet), PACKET_PARAMETER2(packet), PACKET_PARAMETER3(packet));
   
   uint8_t seconds, minutes, hours;
   RTC_Get(&seconds, &minutes, &hours);
@@ -259,13 +369,14 @@ bool HandleSetTimePacket(void)
  *              1 for synchronous (interrupts)
  * Parameter3 = 0
  *
+ * @param packet The packet to handle.
  * @return bool - TRUE if the packet was handled successfully, FALSE if parameters out of range.
  */
-bool HandleModePacket(void)
+bool HandleModePacket(const TPacket* const packet)
 {
-  if (Packet_Parameter1 == 0x02) // If the packet is for SET change the mode using Accel_SetMode()
+  if (PACKET_PARAMETER1(packet) == 0x02) // If the packet is for SET change the mode using Accel_SetMode()
   {
-    switch (Packet_Parameter2)
+    switch (PACKET_PARAMETER2(packet))
 	{
 	  case 0:
 	    synchronousMode = false;
@@ -278,7 +389,7 @@ bool HandleModePacket(void)
 	}
   }
   
-  else if (Packet_Parameter1 == 0x01) // If the packet is for GET, just return the current mode
+  else if (PACKET_PARAMETER1(packet) == 0x01) // If the packet is for GET, just return the current mode
     return (Packet_Put(CMD_MODE, 1, synchronousMode, 0));
 
   // If the packet is not in either SET or GET mode, return false
@@ -288,8 +399,720 @@ bool HandleModePacket(void)
 
   
 /*!
- * @brief Handles the packet by first checking to see what type of packet it is and processing it
- * as per the Tower Serial Communication Protocol document.
+ * @brief Handles an Accelerometer Rate packet by either getting or setting the output data rate of the
+ * accelerometer and how its samples are decimated before being sent to the PC.
+ * This allows the accelerometer to be oversampled at 400/800 Hz while only the decimated samples are sent.
+ *
+ * Parameter1 = 1 for GET, 2 for SET
+ * Parameter2 = bits 0-3: output data rate (0 = 800 Hz ... 7 = 1.56 Hz, see TOutputDataRate)
+ *              bits 4-7: decimation mode (0 = off, 1 = average, 2 = CIC, 3 = low-pass, see TDecimateMode)
+ * Parameter3 = decimation factor (a power of 2 up to DECIMATE_MAX_FACTOR)
+ *
+ * @param packet The packet to handle.
+ * @return bool - TRUE if the packet was handled successfully, FALSE if parameters out of range.
+ */
+bool HandleAccelRatePacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) == 0x02) // If the packet is for SET, change the rate and restart the decimator
+  {
+    TOutputDataRate rate = (TOutputDataRate)(PACKET_PARAMETER2(packet) & 0x0F);
+    TDecimateMode mode   = (TDecimateMode)(PACKET_PARAMETER2(packet) >> 4);
+
+    if (rate > DATE_RATE_1_56_HZ)
+      return false;
+
+    if (!Decimate_Init(&accelDecimator, mode, PACKET_PARAMETER3(packet)))
+      return false;
+
+    accelRate = rate;
+    Accel_SetRate(accelRate);
+    return true;
+  }
+
+  else if (PACKET_PARAMETER1(packet) == 0x01) // If the packet is for GET, return the current rate, mode and factor
+    return Packet_Put(CMD_ACCELRATE, 1, (accelDecimator.mode << 4) | accelRate, accelDecimator.factor);
+
+  // If the packet is not in either SET or GET mode, return false
+  return false;
+}
+
+
+
+/*!
+ * @brief Sends the statistics of one accelerometer axis back to the PC as four Statistics packets.
+ *
+ * Parameter1 = axis (bits 4-7) and item (bits 0-3)
+ * Parameter2 = LSB, Parameter3 = MSB of the item:
+ *   mean in 1/256ths of an LSB, variance in 1/4s of an LSB squared, RMS in 1/256ths of an LSB
+ * For the min/max item, Parameter2 = minimum and Parameter3 = maximum
+ *
+ * @param link The link to send the packets on.
+ * @param axis 0, 1 or 2 for X, Y or Z.
+ * @return bool - TRUE if the packets were all sent.
+ */
+bool SendStats(TPacketLink* const link, const uint8_t axis)
+{
+  TStatsResult result;
+  uint16union_t mean, variance, rms;
+
+  if (!Stats_Get(&accelStats, axis, &result))
+    return false;
+
+  mean.l     = (uint16_t)result.mean;
+  variance.l = (result.variance >> 6) > 0xFFFF ? 0xFFFF : (uint16_t)(result.variance >> 6); // 1/256ths -> 1/4s
+  rms.l      = result.rms;
+
+  return (Packet_LinkPut(link, CMD_STATS, (axis << 4) | STATS_ITEM_MEAN, mean.s.Lo, mean.s.Hi) &&
+	  Packet_LinkPut(link, CMD_STATS, (axis << 4) | STATS_ITEM_VARIANCE, variance.s.Lo, variance.s.Hi) &&
+	  Packet_LinkPut(link, CMD_STATS, (axis << 4) | STATS_ITEM_RMS, rms.s.Lo, rms.s.Hi) &&
+	  Packet_LinkPut(link, CMD_STATS, (axis << 4) | STATS_ITEM_MINMAX, (uint8_t)result.min, (uint8_t)result.max));
+}
+
+
+
+/*!
+ * @brief Handles a Statistics packet by either sending the statistics of the accelerometer data
+ * over the current window, or setting the window size and whether statistics are sent every second.
+ * Sending a summary rather than every sample cuts the load on the serial link for condition monitoring.
+ *
+ * Parameter1 = 1 for GET, 2 for SET
+ * GET: Parameter2 = axis (0-2 for X, Y or Z, 3 for all axes), Parameter3 = 0
+ * SET: Parameter2 = window size in samples (1-255, 0 for 256)
+ *      Parameter3 = 1 to send statistics for all axes every second, 0 to only send them on request
+ *
+ * @param packet The packet to handle.
+ * @return bool - TRUE if the packet was handled successfully, FALSE if parameters out of range.
+ */
+bool HandleStatsPacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) == 0x02) // If the packet is for SET, restart the window with the new size
+  {
+    uint16_t windowSize = (PACKET_PARAMETER2(packet) == 0) ? STATS_MAX_WINDOW : PACKET_PARAMETER2(packet);
+
+    if (PACKET_PARAMETER3(packet) > 1)
+      return false;
+
+    statsPeriodic = PACKET_PARAMETER3(packet);
+    return Stats_Init(&accelStats, windowSize);
+  }
+
+  else if (PACKET_PARAMETER1(packet) == 0x01) // If the packet is for GET, send the statistics of the requested axes
+  {
+    if (PACKET_PARAMETER2(packet) == 3)
+      return SendStats(&Packet_ControlLink, 0) && SendStats(&Packet_ControlLink, 1) && SendStats(&Packet_ControlLink, 2);
+
+    return SendStats(&Packet_ControlLink, PACKET_PARAMETER2(packet));
+  }
+
+  // If the packet is not in either SET or GET mode, return false
+  return false;
+}
+
+
+
+/*!
+ * @brief Transforms a captured block of accelerometer samples and sends its largest peaks and band energies
+ * back to the PC. This is called from the main loop rather than AccelCallback as the FFT takes a while.
+ *
+ * Header packet: Parameter1 = 0xC0 | axis, Parameter2 = log2 of the FFT size, Parameter3 = number of peaks
+ * Peak packets:  Parameter1 = bin (frequency = bin * data rate / FFT size), Parameter2-3 = amplitude
+ * Band packets:  Parameter1 = 0x80 | band, Parameter2-3 = amplitude of all the bins in the band
+ * Amplitudes are Q15 and one sample LSB is 2^7, so a sine of amplitude A LSBs gives a peak of A * 2^6
+ *
+ * @return bool - TRUE if the packets were all sent.
+ */
+bool SendSpectrum(void)
+{
+  TFFTPeak peaks[FFT_MAX_PEAKS];
+  uint32_t bands[SPECTRUM_NB_BANDS];
+  uint16union_t amplitude;
+  const uint16_t nbBins = (1 << (spectrumLog2Size - 1)) + 1;
+  bool success;
+
+  if (!FFT_Transform(spectrumData, spectrumLog2Size))
+    return false;
+
+  FFT_Power(spectrumData, spectrumLog2Size, spectrumPower);
+  uint8_t nbFound = FFT_Peaks(spectrumPower, nbBins, peaks, spectrumNbPeaks);
+  FFT_Bands(spectrumPower, nbBins, bands, SPECTRUM_NB_BANDS);
+
+  success = Packet_Put(CMD_SPECTRUM, SPECTRUM_HEADER_FLAG | spectrumAxis, spectrumLog2Size, nbFound);
+
+  for (uint8_t i = 0; i < nbFound; i++)
+  {
+    amplitude.l = Stats_Sqrt(peaks[i].power);
+    success = Packet_Put(CMD_SPECTRUM, (uint8_t)peaks[i].bin, amplitude.s.Lo, amplitude.s.Hi) && success;
+  }
+
+  for (uint8_t band = 0; band < SPECTRUM_NB_BANDS; band++)
+  {
+    amplitude.l = Stats_Sqrt(bands[band]);
+    success = Packet_Put(CMD_SPECTRUM, SPECTRUM_BAND_FLAG | band, amplitude.s.Lo, amplitude.s.Hi) && success;
+  }
+
+  return success;
+}
+
+
+
+/*!
+ * @brief Handles a Spectrum packet by starting the capture of a block of samples from one axis of the
+ * accelerometer for an FFT, or by timing the FFT. The spectrum is sent by SendSpectrum once the block is full,
+ * so with the accelerometer at 800 Hz a 256 point spectrum has 3.125 Hz bins up to 400 Hz.
+ *
+ * Parameter1 = 2 to capture, 3 to benchmark
+ * Capture:   Parameter2 = axis (bits 0-3, 0-2 for X, Y or Z) and number of peaks (bits 4-7, up to 4)
+ *            Parameter3 = log2 of the FFT size (6-8 for 64, 128 or 256 samples)
+ * Benchmark: Parameter2 = 0, Parameter3 = log2 of the FFT size
+ *            Replies with Parameter1 = 0xE0 | log2 size, Parameter2-3 = cycles taken / 16
+ *
+ * @param packet The packet to handle.
+ * @return bool - TRUE if the packet was handled successfully, FALSE if parameters out of range.
+ */
+bool HandleSpectrumPacket(const TPacket* const packet)
+{
+  if ((PACKET_PARAMETER3(packet) < FFT_MIN_LOG2_SIZE) || (PACKET_PARAMETER3(packet) > FFT_MAX_LOG2_SIZE))
+    return false;
+
+  if (PACKET_PARAMETER1(packet) == 0x02) // Start capturing a new block, abandoning any capture in progress
+  {
+    uint8_t axis    = PACKET_PARAMETER2(packet) & 0x0F;
+    uint8_t nbPeaks = PACKET_PARAMETER2(packet) >> 4;
+
+    if ((axis > 2) || (nbPeaks > FFT_MAX_PEAKS))
+      return false;
+
+    spectrumCapturing = false;
+    spectrumReady     = false;
+    spectrumAxis      = axis;
+    spectrumNbPeaks   = nbPeaks;
+    spectrumLog2Size  = PACKET_PARAMETER3(packet);
+    spectrumCount     = 0;
+    spectrumCapturing = true;
+    return true;
+  }
+
+  else if (PACKET_PARAMETER1(packet) == 0x03) // Time one FFT and send back the number of cycles it took
+  {
+    uint32_t cycles = FFT_Benchmark(PACKET_PARAMETER3(packet)) >> 4;
+    uint16union_t result;
+
+    result.l = (cycles > 0xFFFF) ? 0xFFFF : (uint16_t)cycles;
+    return Packet_Put(CMD_SPECTRUM, SPECTRUM_BENCHMARK_FLAG | PACKET_PARAMETER3(packet), result.s.Lo, result.s.Hi);
+  }
+
+  return false;
+}
+
+
+
+/*!
+ * @brief Sends the pitch and roll of one sample of accelerometer data back to the PC as a Tilt packet.
+ * Both angles are in tenths of a degree, packed as two 12-bit two's complement numbers:
+ *
+ * Parameter1 = pitch bits 0-7
+ * Parameter2 = pitch bits 8-11 (bits 0-3), roll bits 0-3 (bits 4-7)
+ * Parameter3 = roll bits 4-11
+ *
+ * @param link The link to send the packet on.
+ * @param data The accelerometer data to send the angles of.
+ * @return bool - TRUE if the packet was sent.
+ */
+bool SendTilt(TPacketLink* const link, const TAccelData* const data)
+{
+  TTilt tilt;
+  uint32_t packed;
+
+  Tilt_Get(data, &tilt);
+  packed = ((uint32_t)tilt.pitch & 0x0FFF) | (((uint32_t)tilt.roll & 0x0FFF) << 12);
+
+  return Packet_LinkPut(link, CMD_TILT, (uint8_t)packed, (uint8_t)(packed >> 8), (uint8_t)(packed >> 16));
+}
+
+
+
+/*!
+ * @brief Handles a Tilt packet by either sending the tilt of the most recent accelerometer data,
+ * or setting whether tilt angles are streamed instead of the XYZ data.
+ *
+ * Parameter1 = 1 for GET, 2 for SET
+ * Parameter2 = for SET, 1 to stream Tilt packets in place of Accelerometer packets, 0 to stream XYZ data
+ * Parameter3 = 0
+ *
+ * @param packet The packet to handle.
+ * @return bool - TRUE if the packet was handled successfully, FALSE if parameters out of range.
+ */
+bool HandleTiltPacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) == 0x02) // If the packet is for SET, change what is streamed
+  {
+    if (PACKET_PARAMETER2(packet) > 1)
+      return false;
+
+    tiltStream = PACKET_PARAMETER2(packet);
+    return true;
+  }
+
+  else if (PACKET_PARAMETER1(packet) == 0x01) // If the packet is for GET, send the current tilt
+    return SendTilt(&Packet_ControlLink, &lastAccelData);
+
+  // If the packet is not in either SET or GET mode, return false
+  return false;
+}
+
+
+
+/*!
+ * @brief Adds a sample of accelerometer data to the current batch, and sends the batch on the stream link once it is full.
+ * A batch is sent as a single Accelerometer Batch frame (see Packet_PutFrame) with the data:
+ *
+ * Byte 0    = sequence number, incremented for every batch so the PC can tell if one was lost
+ * Bytes 1-4 = timestamp of the first sample in core clock cycles, LSB first
+ * Bytes 5-  = X, Y, Z of each sample, oldest first
+ *
+ * @param data The accelerometer data to add.
+ * @param stamp When the data was read, from Cycles_Get.
+ * @return bool - TRUE if the sample was added and, if the batch was full, the batch was sent.
+ */
+bool PutAccelBatch(const TAccelData* const data, const uint32_t stamp)
+{
+  uint8_t* sample = &accelBatch[ACCEL_BATCH_HEADER_BYTES + accelBatchCount * 3];
+
+  if (accelBatchCount == 0) // Start a new batch
+  {
+    uint32union_t timestamp;
+    timestamp.l = stamp;
+
+    accelBatch[0] = accelBatchSequence;
+    accelBatch[1] = (uint8_t)timestamp.s.Lo;
+    accelBatch[2] = (uint8_t)(timestamp.s.Lo >> 8);
+    accelBatch[3] = (uint8_t)timestamp.s.Hi;
+    accelBatch[4] = (uint8_t)(timestamp.s.Hi >> 8);
+  }
+
+  sample[0] = data->axes.x;
+  sample[1] = data->axes.y;
+  sample[2] = data->axes.z;
+  accelBatchCount++;
+
+  if (accelBatchCount < accelBatchSize)
+    return true;
+
+  accelBatchSequence++;
+  accelBatchCount = 0;
+  return Packet_LinkPutFrame(streamLink, CMD_ACCELBATCH, accelBatch, ACCEL_BATCH_HEADER_BYTES + accelBatchSize * 3);
+}
+
+
+
+/*!
+ * @brief Handles an Accelerometer Batch packet by getting or setting how many samples of accelerometer data
+ * are sent in each batch frame. Batching saves the command and checksum bytes of every sample, which roughly
+ * doubles the number of samples per second that fit through the serial port.
+ *
+ * Parameter1 = 1 for GET, 2 for SET
+ * Parameter2 = samples per batch (1-32), or 0 to go back to one Accelerometer packet per sample
+ * Parameter3 = 0
+ *
+ * @param packet The packet to handle.
+ * @return bool - TRUE if the packet was handled successfully, FALSE if parameters out of range.
+ */
+bool HandleAccelBatchPacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) == 0x02) // If the packet is for SET, start a fresh batch of the new size
+  {
+    if (PACKET_PARAMETER2(packet) > ACCEL_BATCH_MAX)
+      return false;
+
+    accelBatchSize  = PACKET_PARAMETER2(packet);
+    accelBatchCount = 0;
+    return true;
+  }
+
+  else if (PACKET_PARAMETER1(packet) == 0x01) // If the packet is for GET, return the current batch size
+    return Packet_Put(CMD_ACCELBATCH, 1, accelBatchSize, 0);
+
+  // If the packet is not in either SET or GET mode, return false
+  return false;
+}
+
+
+
+/*!
+ * @brief Handles an Accelerometer Delta packet by getting or setting how many samples of accelerometer data
+ * are sent in each delta compressed frame (see delta.c for the frame format). Every frame starts with a full
+ * sample, so this is also how often the PC can pick the stream back up after a lost frame.
+ *
+ * Parameter1 = 1 for GET, 2 for SET
+ * Parameter2 = samples per frame (1-48), or 0 to stop sending delta compressed frames
+ * Parameter3 = 0
+ *
+ * @param packet The packet to handle.
+ * @return bool - TRUE if the packet was handled successfully, FALSE if parameters out of range.
+ */
+bool HandleAccelDeltaPacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) == 0x02) // If the packet is for SET, start a fresh frame of the new size
+  {
+    if (PACKET_PARAMETER2(packet) == 0)
+    {
+      deltaStream = false;
+      return true;
+    }
+
+    deltaStream = Delta_Init(&accelDelta, PACKET_PARAMETER2(packet));
+    return deltaStream;
+  }
+
+  else if (PACKET_PARAMETER1(packet) == 0x01) // If the packet is for GET, return the current frame size
+    return Packet_Put(CMD_ACCELDELTA, 1, deltaStream ? accelDelta.samplesPerFrame : 0, 0);
+
+  // If the packet is not in either SET or GET mode, return false
+  return false;
+}
+
+
+
+/*!
+ * @brief Sends the state of the subscribed stream as three Subscribe packets, each with the source in the
+ * high nibble of Parameter1, an item in the low nibble and a 16-bit value in Parameter2 (LSB) and Parameter3 (MSB):
+ *
+ * STREAM_ITEM_CREDITS   = credits left
+ * STREAM_ITEM_DROPPED   = low 16 bits of the number of samples dropped for lack of credits or transmit FIFO space
+ * STREAM_ITEM_DECIMATED = low 16 bits of the number of samples skipped by the rate divider
+ *
+ * @return bool - TRUE if the packets were sent.
+ */
+bool SendStreamStatus(void)
+{
+  uint8_t source = accelStream.source << 4;
+  uint16union_t credits, dropped, decimated;
+
+  credits.l   = accelStream.credits;
+  dropped.l   = (uint16_t)accelStream.dropped;
+  decimated.l = (uint16_t)accelStream.decimated;
+
+  return (Packet_Put(CMD_SUBSCRIBE, source | STREAM_ITEM_CREDITS, credits.s.Lo, credits.s.Hi) &&
+	  Packet_Put(CMD_SUBSCRIBE, source | STREAM_ITEM_DROPPED, dropped.s.Lo, dropped.s.Hi) &&
+	  Packet_Put(CMD_SUBSCRIBE, source | STREAM_ITEM_DECIMATED, decimated.s.Lo, decimated.s.Hi));
+}
+
+
+
+/*!
+ * @brief Handles a Subscribe packet, which asks for a stream of accelerometer data with flow control. The tower
+ * only sends a sample while the PC has credits for it, so the stream can not fill the transmit FIFO and crowd
+ * out replies to commands. While subscribed, the accelerometer, tilt, batch and delta streams are not sent.
+ *
+ * Parameter1 = 1 for GET, 2 for SET, 3 for GRANT
+ * GET:   Parameter2 = 0, Parameter3 = 0; replies with the stream status (see SendStreamStatus)
+ * SET:   Parameter2 = 0 to unsubscribe, 1 for raw Accelerometer packets, 2 for filtered and decimated
+ *        Accelerometer packets, 3 for Statistics packets of all axes
+ *        Parameter3 = send one sample in this many (1-255); credits start at 0
+ * GRANT: Parameter2 = LSB, Parameter3 = MSB of the number of credits to add; replies with the stream status
+ *
+ * @param packet The packet to handle.
+ * @return bool - TRUE if the packet was handled successfully, FALSE if parameters out of range.
+ */
+bool HandleSubscribePacket(const TPacket* const packet)
+{
+  switch (PACKET_PARAMETER1(packet))
+  {
+    case 0x01: // GET
+      return SendStreamStatus();
+
+    case 0x02: // SET
+      return Stream_Subscribe(&accelStream, (TStreamSource)PACKET_PARAMETER2(packet), PACKET_PARAMETER3(packet));
+
+    case 0x03: // GRANT
+      Stream_Grant(&accelStream, PACKET_PARAMETER23(packet));
+      return SendStreamStatus();
+
+    default:
+      return false;
+  }
+}
+
+
+
+/*!
+ * @brief Sends a coalesced ACK for the packets handled since the last one, if there are any:
+ *
+ * Command    = Ack Window with the ACK bit set
+ * Parameter1 = sequence number of the newest packet; every packet up to this one has been handled
+ * Parameter2 = LSB, Parameter3 = MSB of the NAK bitmap, where bit i is set if packet (Parameter1 - i)
+ *              failed or never arrived
+ *
+ * @return bool - TRUE if there was nothing to send or the report was sent.
+ */
+bool SendAckReport(void)
+{
+  uint8_t sequence;
+  uint16union_t nakBitmap;
+
+  if (!AckWindow_Peek(&ackWindow, &sequence, &nakBitmap.l))
+    return true;
+
+  // The results stay in the window until the report has actually gone into the transmit FIFO
+  if (!Packet_Put(CMD_ACKWINDOW | PACKET_ACK_MASK, sequence, nakBitmap.s.Lo, nakBitmap.s.Hi))
+    return false;
+
+  AckWindow_Clear(&ackWindow);
+  return true;
+}
+
+
+
+/*!
+ * @brief Handles an Ack Window packet by either getting or setting whether ACKs are coalesced. When they are,
+ * packets asking for an ACK are numbered from 0 in the order they arrive (or by the 4th data byte of a COBS
+ * frame, if there is one), and instead of an ACK or NAK per packet the tower sends SendAckReport every
+ * window size packets, or once the oldest result has waited for the timeout. The Ack Window packet itself
+ * is always ACKed on its own, and any results still waiting are reported before the settings change.
+ *
+ * Parameter1 = 1 for GET, 2 for SET
+ * Parameter2 = packets per report (1-16), or 0 to ACK every packet separately
+ * Parameter3 = timeout in ms (1-255), or 0 for none
+ *
+ * @param packet The packet to handle.
+ * @return bool - TRUE if the packet was handled successfully, FALSE if parameters out of range.
+ */
+bool HandleAckWindowPacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) == 0x02) // If the packet is for SET, report what is waiting and start counting again
+  {
+    if (PACKET_PARAMETER2(packet) > ACKWINDOW_MAX_SIZE)
+      return false;
+
+    return SendAckReport() && AckWindow_Init(&ackWindow, PACKET_PARAMETER2(packet), PACKET_PARAMETER3(packet));
+  }
+
+  else if (PACKET_PARAMETER1(packet) == 0x01) // If the packet is for GET, return the current settings
+    return Packet_Put(CMD_ACKWINDOW, 1, ackWindow.size, ackWindow.timeout);
+
+  // If the packet is not in either SET or GET mode, return false
+  return false;
+}
+
+
+
+/*!
+ * @brief Stores a 32-bit value LSB first.
+ *
+ * @param bytes Where the 4 bytes are stored.
+ * @param value The value to store.
+ */
+void PutLong(uint8_t* const bytes, const uint32_t value)
+{
+  uint32union_t split;
+  split.l = value;
+
+  bytes[0] = (uint8_t)split.s.Lo;
+  bytes[1] = (uint8_t)(split.s.Lo >> 8);
+  bytes[2] = (uint8_t)split.s.Hi;
+  bytes[3] = (uint8_t)(split.s.Hi >> 8);
+}
+
+
+
+/*!
+ * @brief Handles a Ping packet by sending back a Ping frame (see Packet_PutFrame) with timestamps from
+ * the cycle counter, so the PC can split the round trip into getting to the tower, waiting in the tower
+ * and getting back to the PC:
+ *
+ * Bytes 0-1   = the sequence number from the Ping packet, LSB first
+ * Bytes 2-5   = when the last byte of the Ping packet arrived in the UART
+ * Bytes 6-9   = when the main loop took the Ping packet out of the receive FIFO and handled it
+ * Bytes 10-13 = when the reply was put in the transmit FIFO
+ * Bytes 14-15 = the number of bytes ahead of the reply in the transmit FIFO
+ *
+ * Timestamps are core clock cycles (CPU_CORE_CLK_HZ), LSB first.
+ *
+ * Parameter1 = sequence number LSB, Parameter2 = sequence number MSB, Parameter3 = 0
+ *
+ * @param packet The packet to handle.
+ * @return bool - TRUE if the reply was sent.
+ */
+bool HandlePingPacket(const TPacket* const packet)
+{
+  uint32_t handled = Cycles_Get();
+  uint8_t reply[PING_BYTES];
+  uint16union_t queued;
+
+  reply[0] = PACKET_PARAMETER1(packet);
+  reply[1] = PACKET_PARAMETER2(packet);
+  PutLong(&reply[2], Packet_RxStamp);
+  PutLong(&reply[6], handled);
+
+  // Only the main loop sends, so nothing else can get into the FIFO between stamping the reply and putting it there
+  queued.l = UART_OutCount();
+  reply[14] = queued.s.Lo;
+  reply[15] = queued.s.Hi;
+  PutLong(&reply[10], Cycles_Get());
+  return Packet_PutFrame(CMD_PING, reply, PING_BYTES);
+}
+
+
+
+/*!
+ * @brief Puts the usage statistics of a FIFO or ring into a Diagnostics frame.
+ *
+ * @param bytes Where the 20 bytes are put.
+ * @param stats The statistics.
+ */
+void PutFIFOStats(uint8_t* const bytes, const TFIFOStats* const stats)
+{
+  PutLong(&bytes[0], stats->peak);
+  PutLong(&bytes[4], stats->nbIn);
+  PutLong(&bytes[8], stats->nbOut);
+  PutLong(&bytes[12], stats->nbOverflows);
+  PutLong(&bytes[16], stats->nbEmptyGets);
+}
+
+
+
+/*!
+ * @brief Handles a Diagnostics packet by either sending the usage statistics of the queues in the tower
+ * as a Diagnostics frame (see Packet_PutFrame), or clearing them. This shows whether each FIFO is big
+ * enough, and whether lost accelerometer data was dropped in the transmit FIFO or never got to it.
+ *
+ * The frame is all 32-bit values, LSB first:
+ *
+ * Bytes 0-99    = for each of the UART2 receive FIFO, UART2 transmit FIFO, UART1 receive FIFO, UART1 transmit
+ *                 FIFO and accelerometer sample queue: peak count, number in, number out, number turned away
+ *                 because it was full and number of gets while it was empty
+ * Bytes 100-111 = most bytes waiting at the start of a dispatch pass, passes over time, passes left unfinished
+ * Bytes 112-127 = framing errors and packets dropped for lack of transmit FIFO space, on the control link
+ *                 then the data link
+ *
+ * Parameter1 = 1 for GET, 2 for SET, which clears the statistics
+ * Parameter2 = 0
+ * Parameter3 = 0
+ *
+ * @param packet The packet to handle.
+ * @return bool - TRUE if the packet was handled successfully, FALSE if parameters out of range.
+ */
+bool HandleDiagnosticsPacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) == 0x02) // If the packet is for SET, start counting again
+  {
+    EnterCritical();
+    UART_PortResetStats(&UART_Port2);
+    UART_PortResetStats(&UART_Port1);
+    Ring_ResetStats(&accelQueue);
+    dispatchMaxDepth                 = 0;
+    dispatchOverruns                 = 0;
+    dispatchDeferred                 = 0;
+    Packet_ControlLink.framingErrors = 0;
+    Packet_ControlLink.nbDropped     = 0;
+    dataLink.framingErrors           = 0;
+    dataLink.nbDropped               = 0;
+    ExitCritical();
+    return true;
+  }
+
+  else if (PACKET_PARAMETER1(packet) == 0x01) // If the packet is for GET, send the statistics
+  {
+    uint8_t reply[DIAGNOSTICS_BYTES];
+    TFIFOStats stats[DIAGNOSTICS_NB_QUEUES];
+
+    UART_PortGetStats(&UART_Port2, &stats[0], &stats[1]);
+    UART_PortGetStats(&UART_Port1, &stats[2], &stats[3]);
+    stats[4] = accelQueue.stats;
+
+    for (uint8_t i = 0; i < DIAGNOSTICS_NB_QUEUES; i++)
+      PutFIFOStats(&reply[i * 20], &stats[i]);
+
+    PutLong(&reply[100], dispatchMaxDepth);
+    PutLong(&reply[104], dispatchOverruns);
+    PutLong(&reply[108], dispatchDeferred);
+    PutLong(&reply[112], Packet_ControlLink.framingErrors);
+    PutLong(&reply[116], Packet_ControlLink.nbDropped);
+    PutLong(&reply[120], dataLink.framingErrors);
+    PutLong(&reply[124], dataLink.nbDropped);
+
+    return Packet_PutFrame(CMD_DIAGNOSTICS, reply, DIAGNOSTICS_BYTES);
+  }
+
+  // If the packet is not in either SET or GET mode, return false
+  return false;
+}
+
+
+
+/*!
+ * @brief Handles a Framing packet by either getting or setting how packets are framed on the serial port.
+ * The reply (and ACK) is sent with the old framing, and every packet after that uses the new framing.
+ *
+ * Parameter1 = 1 for GET, 2 for SET
+ * Parameter2 = 0 for fixed 5-byte packets, 1 for COBS frames with a CRC-16 (see packet.c)
+ * Parameter3 = 0
+ *
+ * @param packet The packet to handle.
+ * @return bool - TRUE if the packet was handled successfully, FALSE if parameters out of range.
+ */
+bool HandleFramingPacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) == 0x02) // If the packet is for SET, change the framing after the ACK has gone
+  {
+    if (PACKET_PARAMETER2(packet) > PACKET_FRAMING_COBS)
+      return false;
+
+    newFraming    = (TPacketFraming)PACKET_PARAMETER2(packet);
+    framingChange = true;
+    return true;
+  }
+
+  else if (PACKET_PARAMETER1(packet) == 0x01) // If the packet is for GET, return the current framing
+    return Packet_Put(CMD_FRAMING, 1, Packet_GetFraming(), 0);
+
+  // If the packet is not in either SET or GET mode, return false
+  return false;
+}
+
+
+
+/*!
+ * @brief Handles a Stream Link packet by either getting or setting which serial link the accelerometer data,
+ * periodic statistics and batch, delta and tilt streams are sent on. Moving them to the data link on UART1
+ * means a long run of stream data can not hold up the replies to commands on UART2.
+ * Nothing is read from the data link, so commands (and stream credits) always go to the control link.
+ *
+ * Parameter1 = 1 for GET, 2 for SET
+ * Parameter2 = 0 for the control link, 1 for the data link
+ * Parameter3 = for SET, the framing of the data link (0 for fixed, 1 for COBS)
+ *
+ * @param packet The packet to handle.
+ * @return bool - TRUE if the packet was handled successfully, FALSE if parameters out of range.
+ */
+bool HandleStreamLinkPacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) == 0x02) // If the packet is for SET, move the streams to the chosen link
+  {
+    if (PACKET_PARAMETER2(packet) > 1)
+      return false;
+
+    if ((PACKET_PARAMETER2(packet) == 1) && !Packet_LinkSetFraming(&dataLink, (TPacketFraming)PACKET_PARAMETER3(packet)))
+      return false;
+
+    streamLink        = (PACKET_PARAMETER2(packet) == 1) ? &dataLink : &Packet_ControlLink;
+    accelStream.port  = streamLink->port;
+    return true;
+  }
+
+  else if (PACKET_PARAMETER1(packet) == 0x01) // If the packet is for GET, return the current link and its framing
+    return Packet_Put(CMD_STREAMLINK, 1, (streamLink == &dataLink), streamLink->framing);
+
+  // If the packet is not in either SET or GET mode, return false
+  return false;
+}
+
+
+
+/*!
+ * @brief Handles the packet by first checking whether an acknowledgement is wanted and then passing it
+ * to the handler registered for its command with Packet_RegisterHandler, as per the Tower Serial
+ * Communication Protocol document.
  */
 void HandlePacket(void)
 {
@@ -302,36 +1125,7 @@ void HandlePacket(void)
     Packet_Command &= 0x7F; //Strips the top bit of the Command Byte to ignore ACK bit
   }
 
-  switch (Packet_Command)
-  {
-    case CMD_STARTUP:
-      success = HandleStartupPacket();
-      break;
-    case CMD_VERSION:
-      success = HandleVersionPacket();
-      break;
-    case CMD_NUMBER:
-      success = HandleNumberPacket();
-      break;
-    case CMD_TOWERMODE:
-      success = HandleTowerModePacket();
-      break;
-    case CMD_PROGBYTE:
-      success = HandleProgBytePacket();
-      break;
-    case CMD_READBYTE:
-      success = HandleReadBytePacket();
-      break;
-    case CMD_SETTIME:
-      success = HandleSetTimePacket();
-      break;
-	case CMD_MODE:
-	  success = HandleModePacket();
-	  break;
-    default:
-      success = false;
-      break;
-  }
+  success = Packet_Handle(&Packet); // FALSE if no handler is registered for the command
 
   /*!
    * Check if the handling of the packet was a success and an ACK packet was requested
@@ -341,7 +1135,26 @@ void HandlePacket(void)
    * Finally, return the ACK packet to the Tower
    */
 
-  if (ackReq)
+  if (ackReq && (ackWindow.size > 0) && (Packet_Command != CMD_ACKWINDOW)) // Coalesce the ACK
+  {
+    bool explicitSequence = (Packet_GetFraming() == PACKET_FRAMING_COBS) && (Packet_FrameLength > 3);
+    uint8_t sequence      = explicitSequence ? Packet_FrameData[3] : ackWindow.nextSequence;
+
+    // A gap would push results out before they are reported, so report the waiting results first,
+    // and then the missing packets ACKWINDOW_MAX_SIZE at a time until the gap fits
+    while (!AckWindow_Fits(&ackWindow, sequence))
+    {
+      if (ackWindow.nbPending == 0)
+        AckWindow_PutGap(&ackWindow);
+
+      if (!SendAckReport())
+        break; // No room in the transmit FIFO, so the results that do not fit are lost
+    }
+
+    if (AckWindow_Put(&ackWindow, sequence, success))
+      (void)SendAckReport();
+  }
+  else if (ackReq)
   {
     if (success)
       Packet_Command |= PACKET_ACK_MASK; // Set the ACK bit
@@ -350,10 +1163,98 @@ void HandlePacket(void)
 
     Packet_Put(Packet_Command, Packet_Parameter1, Packet_Parameter2, Packet_Parameter3); // Send the ACK/NAK packet back out
   }
+
+  if (framingChange) // Only switch framing once any reply to the Framing packet has been sent
+  {
+    framingChange = false;
+    Packet_SetFraming(newFraming);
+  }
 }
   
   
   
+/*!
+ * @brief Handles the packets waiting in the receive FIFO, up to DISPATCH_MAX_PACKETS of them or until
+ * DISPATCH_MAX_CYCLES have gone by, so a burst of commands is cleared in a few passes of the main loop
+ * without holding up the accelerometer for too long.
+ */
+void DispatchPackets(void)
+{
+  uint32_t start = Cycles_Get();
+  uint16_t depth = UART_InCount();
+
+  if (depth > dispatchMaxDepth)
+    dispatchMaxDepth = depth;
+
+  for (uint8_t i = 0; i < DISPATCH_MAX_PACKETS; i++)
+  {
+    if (!Packet_Get()) // Nothing more waiting
+      return;
+
+    HandlePacket();
+
+    if (Cycles_Get() - start > DISPATCH_MAX_CYCLES) // Out of time, leave the rest for the next pass
+    {
+      dispatchOverruns++;
+      return;
+    }
+  }
+
+  if (UART_InCount() > 0)
+    dispatchDeferred++;
+}
+
+
+
+/*!
+ * @brief Registers the handlers for all of the commands the tower understands.
+ *
+ * @return bool - TRUE if all of the handlers were registered.
+ */
+bool RegisterHandlers(void)
+{
+  return (Packet_RegisterHandler(CMD_STARTUP, HandleStartupPacket) &&
+	  Packet_RegisterHandler(CMD_VERSION, HandleVersionPacket) &&
+	  Packet_RegisterHandler(CMD_NUMBER, HandleNumberPacket) &&
+	  Packet_RegisterHandler(CMD_TOWERMODE, HandleTowerModePacket) &&
+	  Packet_RegisterHandler(CMD_PROGBYTE, HandleProgBytePacket) &&
+	  Packet_RegisterHandler(CMD_READBYTE, HandleReadBytePacket) &&
+	  Packet_RegisterHandler(CMD_SETTIME, HandleSetTimePacket) &&
+	  Packet_RegisterHandler(CMD_MODE, HandleModePacket) &&
+	  Packet_RegisterHandler(CMD_ACCELRATE, HandleAccelRatePacket) &&
+	  Packet_RegisterHandler(CMD_STATS, HandleStatsPacket) &&
+	  Packet_RegisterHandler(CMD_SPECTRUM, HandleSpectrumPacket) &&
+	  Packet_RegisterHandler(CMD_TILT, HandleTiltPacket) &&
+	  Packet_RegisterHandler(CMD_ACCELBATCH, HandleAccelBatchPacket) &&
+	  Packet_RegisterHandler(CMD_FRAMING, HandleFramingPacket) &&
+	  Packet_RegisterHandler(CMD_ACCELDELTA, HandleAccelDeltaPacket) &&
+	  Packet_RegisterHandler(CMD_PING, HandlePingPacket) &&
+	  Packet_RegisterHandler(CMD_SUBSCRIBE, HandleSubscribePacket) &&
+	  Packet_RegisterHandler(CMD_ACKWINDOW, HandleAckWindowPacket) &&
+	  Packet_RegisterHandler(CMD_STREAMLINK, HandleStreamLinkPacket) &&
+	  Packet_RegisterHandler(CMD_DIAGNOSTICS, HandleDiagnosticsPacket));
+}
+
+
+
+/*!
+ * @brief Sends the clock time back to the PC, just as in HandleSetTimePacket, and if periodic statistics
+ * are on, the per-second summary of the accelerometer data as well. This runs in the main loop rather than
+ * in RTCCallback, so the statistics are never read while ProcessAccelSample is part way through updating them.
+ */
+void SendSecondReport(void)
+{
+  uint8_t seconds, minutes, hours;
+  RTC_Get(&seconds, &minutes, &hours);
+
+  Packet_Put(CMD_SETTIME, seconds, minutes, hours);
+
+  if (statsPeriodic)
+    (void)(SendStats(streamLink, 0) && SendStats(streamLink, 1) && SendStats(streamLink, 2));
+}
+
+
+
 /*************************************/
 /** CALLBACK FUNCTIONS FOR ALL ISRs **/
 /*************************************/
@@ -367,16 +1268,12 @@ void PITCallback(void* arg)
 }
   
 /*! @brief User callback function for use as an RTC_Init parameter
- *  Every second the RTC interrupt occurs to send back clock time to the PC and toggles Yellow LED
+ *  Every second the RTC interrupt occurs to toggle Yellow LED and have the main loop send the time (see SendSecondReport)
  */
 void RTCCallback(void* arg)
 {
-  // Get and send time back to PC, just as in HandleSetTimePacket
-  uint8_t seconds, minutes, hours;
-  RTC_Get(&seconds, &minutes, &hours);
-
   LEDs_Toggle(LED_YELLOW);
-  Packet_Put(CMD_SETTIME, seconds, minutes, hours);
+  secondElapsed = true;
 }
 
 /*! @brief User callback function for use as an FTM_Set parameter
@@ -388,39 +1285,88 @@ void FTM0Callback(void* arg)
 }
 
 /*! @brief User callback function for the accelerometer data reading
- *  After data is ready to be read, call Accel_ReadXYZ and save its data and send it back to the PC
+ *  After data is ready to be read, start Accel_ReadXYZ into accelSample, stamped with when it was started
+ *  In interrupt mode the read finishes later and I2CCallback queues the sample, while a polled read is done
+ *  on return so the sample is queued here. Either way the filtering and sending are left to the main loop.
  */
 void AccelCallback(void* arg)
 {
-  // array of 3 unions and one separate union to save data from the accelerometer readings
-  // saves data from the three most recent Accel_ReadXYZ calls to allow for median filtering
-  static TAccelData accelData[3];
+  accelSample.stamp = Cycles_Get();
+  Accel_ReadXYZ(accelSample.data.bytes);
+
+  if (!synchronousMode)
+    (void)Ring_Put(&accelQueue, &accelSample); // if the main loop has fallen behind, the ring counts the lost sample
+}
+
+/*! @brief Processes one sample of accelerometer data from the queue and sends it back to the PC
+ *  Median filtered data is passed through the decimator so only one packet is sent per decimated sample
+ *
+ *  @param sample The sample, as queued by AccelCallback or I2CCallback.
+ */
+void ProcessAccelSample(const TAccelSample* const sample)
+{
+  TAccelData accelData = sample->data;
   TAccelData medianData;
+  TAccelData decimatedData;
+
+  if ((accelStream.source == STREAM_RAW) && Stream_Take(&accelStream, 1))
+    Packet_LinkPut(streamLink, CMD_ACCEL, accelData.bytes[0], accelData.bytes[1], accelData.bytes[2]);
   
-  // shifts data in the array unions back (index 0 is most recent data, 2 is oldest data)
-  for (uint8_t i = 0; i < 3; i++)
-  {
-	accelData[2].bytes[i] = accelData[1].bytes[i];
-    accelData[1].bytes[i] = accelData[0].bytes[i];
-  }
+  // Median filters against the previous 2 sets of XYZ data, which are kept in accelMedian
+  Median_Filter3Block(&accelMedian, accelData.bytes, medianData.bytes, 1);
+  
+  // Statistics are kept at the full data rate, before decimation
+  Stats_PutBlock(&accelStats, &medianData, 1);
 
-  Accel_ReadXYZ(&accelData[0].bytes);
+  if ((accelStream.source == STREAM_STATS) && Stream_Take(&accelStream, 12)) // 4 packets per axis
+    (void)(SendStats(streamLink, 0) && SendStats(streamLink, 1) && SendStats(streamLink, 2));
   
-  // Median filters the last 3 sets of XYZ data
-  for (uint8_t i = 0; i < 3; i++)
+  // Fill the spectrum block at the full data rate, Q7 -> Q14 to leave headroom for the FFT
+  if (spectrumCapturing)
   {
-    medianData.bytes[i] = MedianFilter3(accelData[0].bytes[i], accelData[1].bytes[i], accelData[2].bytes[i]);
+    spectrumData[spectrumCount].re = (int16_t)((int8_t)medianData.bytes[spectrumAxis] * 128);
+    spectrumData[spectrumCount].im = 0;
+    spectrumCount++;
+
+    if (spectrumCount >= (1 << spectrumLog2Size))
+    {
+      spectrumCapturing = false;
+      spectrumReady     = true;
+    }
   }
   
-  Packet_Put(CMD_ACCEL, medianData.bytes[0], medianData.bytes[1], medianData.bytes[2]);
+  if (Decimate_Put(&accelDecimator, &medianData, &decimatedData))
+  {
+    lastAccelData = decimatedData;
+
+    if (accelStream.source != STREAM_OFF)
+    {
+      if ((accelStream.source == STREAM_FILTERED) && Stream_Take(&accelStream, 1))
+        Packet_LinkPut(streamLink, CMD_ACCEL, decimatedData.bytes[0], decimatedData.bytes[1], decimatedData.bytes[2]);
+    }
+    else if (tiltStream)
+      SendTilt(streamLink, &decimatedData);
+    else if (deltaStream)
+    {
+      uint8_t length = Delta_Put(&accelDelta, &decimatedData);
+
+      if (length > 0)
+        Packet_LinkPutFrame(streamLink, CMD_ACCELDELTA, accelDelta.frame, length);
+    }
+    else if (accelBatchSize > 0)
+      PutAccelBatch(&decimatedData, sample->stamp);
+    else
+      Packet_LinkPut(streamLink, CMD_ACCEL, decimatedData.bytes[0], decimatedData.bytes[1], decimatedData.bytes[2]);
+  }
 }
  
 /*! @brief User callback function for the I2C data complete
- *  After data read from AccelCallback, I2C_ISR is triggered to toggle the green LED 
+ *  After data read from AccelCallback, I2C_ISR is triggered to toggle the green LED and queue the sample for the main loop
  */
 void I2CCallback(void* arg)
 {
   LEDs_Toggle(LED_GREEN);
+  (void)Ring_Put(&accelQueue, &accelSample); // if the main loop has fallen behind, the ring counts the lost sample
 }
 
 
@@ -435,6 +1381,7 @@ int main(void)
   /* Write your local variable definition here */
 
   const uint32_t BAUDRATE      = 115200;
+  const uint32_t DATABAUDRATE  = 230400;
   const uint32_t ACCELBAUDRATE = 100000;
 
   TFTMChannel FTM0Channel0; // Struct to set up channel 0 in the FTM module
@@ -463,29 +1410,64 @@ int main(void)
   __DI(); // Disable interrupts
   
   if (Packet_Init(BAUDRATE, CPU_BUS_CLK_HZ) &&
+      Packet_LinkInit(&dataLink, &UART_Port1, DATABAUDRATE, CPU_CORE_CLK_HZ) &&
+      UART_PortEnableDMA(&UART_Port2, UART_DMA_TX) && // commands are received on interrupts to stamp when they arrive
+      UART_PortEnableDMA(&UART_Port1, UART_DMA_TX) &&
+      RegisterHandlers() &&
       Flash_Init() &&
       LEDs_Init() &&
       FTM_Init() &&
       FTM_Set(&FTM0Channel0) &&
       PIT_Init(CPU_BUS_CLK_HZ, PITCallback, NULL) && 
       RTC_Init(RTCCallback, NULL) &&
-	  Accel_Init(accelSetup))
+	  Accel_Init(accelSetup) &&
+	  Decimate_Init(&accelDecimator, DECIMATE_OFF, 1) &&
+	  Stats_Init(&accelStats, STATS_MAX_WINDOW) &&
+	  RING_INIT(&accelQueue, accelQueueStorage) &&
+	  Cycles_Init())
   {
+    Median_Init(&accelMedian);
+    Stream_Init(&accelStream, streamLink->port);
+    (void)AckWindow_Init(&ackWindow, 0, 0);
+
     // PIT_Set(500000000, true);
     // PIT_Enable(true);
     LEDs_On(LED_ORANGE);
-    HandleStartupPacket();
+    HandleStartupPacket(NULL);
 	
     __EI(); // Enable interrupts
 
     for (;;)
     {
-      if (Packet_Get()) // If a packet is received.
-        HandlePacket(); // Handle the packet appropriately.
+      DispatchPackets(); // Handle the packets received since the last pass
+
+      if (AckWindow_Due(&ackWindow)) // Don't keep coalesced ACKs waiting too long
+        (void)SendAckReport();
       // UART_Poll(); // Continue polling the UART for activity - uncomment for use in Lab 1 or 2
 	  
 	  if (!synchronousMode)
 		AccelCallback(NULL); // If I2C is in polling mode, keep polling here for new data
+
+      // Filter and send the samples that have been queued, without counting an empty get every pass
+      for (uint16_t nbSamples = Ring_Count(&accelQueue); nbSamples > 0; nbSamples--)
+      {
+        TAccelSample sample;
+
+        (void)Ring_Get(&accelQueue, &sample);
+        ProcessAccelSample(&sample);
+      }
+
+      if (secondElapsed) // Once a second, send the time and any periodic statistics
+      {
+        secondElapsed = false;
+        SendSecondReport();
+      }
+
+      if (spectrumReady) // If a block of samples has been captured, send its spectrum
+      {
+        spectrumReady = false;
+        SendSpectrum();
+      }
     }
   }
 
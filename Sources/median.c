@@ -14,17 +14,76 @@
 **  @{
 */
 
+#include "median.h"
+
+// private macros for the branch-free median of 3
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
 uint8_t Median_Filter3(const uint8_t n1, const uint8_t n2, const uint8_t n3)
 {
-	if ((n1 >= n2 && n1 <= n3) || (n1 <= n2 && n1 >= n3))
-	  return n1;
-  
-    if ((n2 >= n1 && n2 <= n3) || (n2 <= n1 && n2 >= n3))
-      return n2;
-	
-	if ((n3 >= n1 && n3 <= n2) || (n3 <= n1 && n3 >= n2))
-	  return n3;
-  
-    else
-	  return n1; // n1 will be the most recent data, incase that n2 or n3 are NULL
-}
\ No newline at end of file
+  // The samples are two's complement accelerations, so they must be ordered as signed values
+  int8_t s1 = (int8_t)n1;
+  int8_t s2 = (int8_t)n2;
+  int8_t s3 = (int8_t)n3;
+
+  return (uint8_t)MAX(MIN(s1, s2), MIN(MAX(s1, s2), s3));
+}
+
+
+
+/*! @brief Clears the history of a block median filter.
+ *
+ *  @param filter A pointer to the filter to initialize.
+ */
+void Median_Init(TMedianFilter3* const filter)
+{
+  for (uint8_t axis = 0; axis < 3; axis++)
+  {
+    filter->older[axis] = 0;
+    filter->newer[axis] = 0;
+  }
+}
+
+
+
+/*! @brief Median filters a block of interleaved XYZ samples.
+ *
+ *  Each output is the median of that sample and the two before it, per axis.
+ *  The last two samples are kept in filter so consecutive blocks form one continuous signal.
+ *  Samples are ordered as signed (int8_t) values.
+ *  @param filter A pointer to the filter history.
+ *  @param input nbSamples interleaved {x, y, z} samples.
+ *  @param output nbSamples interleaved {x, y, z} filtered samples (may be the same as input).
+ *  @param nbSamples The number of XYZ samples to filter.
+ *  @note Assumes that Median_Init has been called.
+ */
+void Median_Filter3Block(TMedianFilter3* const filter, const uint8_t* const input, uint8_t* const output,
+                         const uint16_t nbSamples)
+{
+  // One pass per axis keeps the window in local variables rather than reloading it every sample
+  for (uint8_t axis = 0; axis < 3; axis++)
+  {
+    // The samples are two's complement accelerations, so they must be ordered as signed values
+    int8_t older = (int8_t)filter->older[axis];
+    int8_t newer = (int8_t)filter->newer[axis];
+    const uint8_t* in = input + axis;
+    uint8_t* out      = output + axis;
+
+    for (uint16_t n = nbSamples; n > 0; n--)
+    {
+      int8_t newest = (int8_t)*in;
+      int8_t lo     = MIN(older, newer);
+      int8_t hi     = MAX(older, newer);
+
+      *out  = (uint8_t)MAX(lo, MIN(hi, newest));
+      older = newer;
+      newer = newest;
+      in   += 3;
+      out  += 3;
+    }
+
+    filter->older[axis] = (uint8_t)older;
+    filter->newer[axis] = (uint8_t)newer;
+  }
+}
@@ -19,7 +19,37 @@
  *  @param n1 is the first  of 3 bytes for which the median is sought.
  *  @param n2 is the second of 3 bytes for which the median is sought.
  *  @param n3 is the third  of 3 bytes for which the median is sought.
+ *  @return uint8_t - the median, with the bytes ordered as signed (int8_t) values.
  */
 uint8_t Median_Filter3(const uint8_t n1, const uint8_t n2, const uint8_t n3);
 
+/*!
+ * @struct TMedianFilter3
+ */
+typedef struct
+{
+  uint8_t older[3];		/*!< The second most recent XYZ sample */
+  uint8_t newer[3];		/*!< The most recent XYZ sample */
+} TMedianFilter3;
+
+/*! @brief Clears the history of a block median filter.
+ *
+ *  @param filter A pointer to the filter to initialize.
+ */
+void Median_Init(TMedianFilter3* const filter);
+
+/*! @brief Median filters a block of interleaved XYZ samples.
+ *
+ *  Each output is the median of that sample and the two before it, per axis.
+ *  The last two samples are kept in filter so consecutive blocks form one continuous signal.
+ *  Samples are ordered as signed (int8_t) values.
+ *  @param filter A pointer to the filter history.
+ *  @param input nbSamples interleaved {x, y, z} samples.
+ *  @param output nbSamples interleaved {x, y, z} filtered samples (may be the same as input).
+ *  @param nbSamples The number of XYZ samples to filter.
+ *  @note Assumes that Median_Init has been called.
+ */
+void Median_Filter3Block(TMedianFilter3* const filter, const uint8_t* const input, uint8_t* const output,
+                         const uint16_t nbSamples);
+
 #endif
@@ -0,0 +1,665 @@
+/*! @file packet.c
+ *
+ *  @brief Routines to implement packet encoding and decoding for the serial port.
+ *
+ *  This contains the functions for implementing the "Tower to PC Protocol" 5-byte packets,
+ *  and variable length frames for sending bulk data.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-21
+ */
+/*!
+**  @addtogroup main_module main module documentation
+**
+**  @author Thanit Tangson
+**  @{
+*/
+
+/*
+
+Two framings are supported and the PC picks one with the Framing command:
+
+PACKET_FRAMING_FIXED - the original 5-byte packets (command, 3 parameters, XOR checksum). Bulk data is
+  sent with Packet_PutFrame as command, length, data, XOR checksum.
+
+PACKET_FRAMING_COBS - every packet or frame is command, data, CRC-16 (LSB first), encoded with
+  Consistent Overhead Byte Stuffing so that it contains no zero bytes, and then ended with a zero byte.
+  A frame can be any length, and a receiver that loses sync is back in step at the next zero byte.
+
+Both framings use the same UART FIFOs, so the switch happens between whole packets.
+
+All of the receiver state, the framing and the statistics belong to a TPacketLink, which is bound to a
+UART, so more than one serial link can be served at once. The handler table is shared by all links.
+The original Packet_ functions use Packet_ControlLink on UART2.
+
+Packets are only sent from the main loop, so each transmit FIFO has a single writer and a packet is
+reserved, encoded and committed without disabling interrupts. Callbacks that have something to report
+set a flag for the main loop instead (see RTCCallback).
+
+Received bytes are parsed in place in the receive FIFO (see UART_PortInPeek) and only removed from it
+once they have been used, so a packet is taken out a segment at a time instead of a byte at a time.
+
+5-byte packets are received into a 5-byte ring that holds the XOR of its bytes, which is zero for a
+packet with a good checksum. While in sync, a packet with a good checksum is accepted whatever its
+command, so the handler can NAK a command it does not know. Otherwise the oldest byte is dropped and
+the XOR updated with the byte going out and the byte coming in, and sync is only found again at a good
+packet for a registered command. This costs the same small amount per byte however long the data
+stays bad.
+
+*/
+
+#include "packet.h"
+
+// UART is used to send and receive the packet bytes
+#include "UART.h"
+
+// CRC used by the COBS framing
+#include "CRC16.h"
+
+// memchr and memcpy for parsing received bytes in place
+#include <string.h>
+
+// CPU and PE_types are needed for critical section variables and the defintion of NULL pointer
+#include "Cpu.h"
+#include "PE_Types.h"
+
+TPacketLink Packet_ControlLink; // The link commands arrive on
+
+const uint8_t PACKET_ACK_MASK = 0x80;
+
+// Longest run of non-zero bytes in a COBS block
+#define COBS_BLOCK_SIZE 254
+
+// Bytes needed in the transmit FIFO for nbDecoded bytes, once encoded and delimited
+#define COBS_ENCODED_SIZE(nbDecoded) ((nbDecoded) + (nbDecoded) / COBS_BLOCK_SIZE + 2)
+
+/*!
+ * @struct TCOBSEncoder
+ */
+typedef struct
+{
+  TUARTPort* port;			/*!< The UART the frame is sent on */
+  TFIFOSpan span;			/*!< The space reserved in the transmit FIFO for the encoded frame */
+  uint16_t position;			/*!< Where the next byte is written in span */
+  uint16_t codePosition;		/*!< Where the code byte of the current block goes, once its length is known */
+  uint8_t code;				/*!< The code byte of the current block, one more than its number of bytes */
+} TCOBSEncoder;
+
+static TPacketHandler Handlers[PACKET_NB_COMMANDS]; // private global table of command handlers, indexed by command
+
+
+// private function to calculate the checksum of the first 4 bytes of a packet
+static uint8_t Checksum(const uint8_t command, const uint8_t parameter1, const uint8_t parameter2, const uint8_t parameter3)
+{
+  return (command ^ parameter1 ^ parameter2 ^ parameter3);
+}
+
+
+
+// private function to start encoding a COBS frame into a reservation of the transmit FIFO
+static bool COBSStart(TCOBSEncoder* const encoder, TUARTPort* const port, const uint16_t nbDecoded)
+{
+  if (!UART_PortOutReserve(port, COBS_ENCODED_SIZE(nbDecoded), &encoder->span))
+    return false;
+
+  encoder->port         = port;
+  encoder->codePosition = 0;
+  encoder->position     = 1;
+  encoder->code         = 1;
+  return true;
+}
+
+// private function to fill in the code byte of the current block and start a new one
+static void COBSEndBlock(TCOBSEncoder* const encoder)
+{
+  FIFO_SpanWrite(&encoder->span, encoder->codePosition, encoder->code);
+  encoder->codePosition = encoder->position++;
+  encoder->code         = 1;
+}
+
+// private function to COBS encode one byte
+static void COBSPut(TCOBSEncoder* const encoder, const uint8_t data)
+{
+  if (data == 0) // a zero ends the block, and is implied by its code byte
+  {
+    COBSEndBlock(encoder);
+    return;
+  }
+
+  FIFO_SpanWrite(&encoder->span, encoder->position++, data);
+
+  if (++encoder->code == COBS_BLOCK_SIZE + 1) // a full block has no implied zero
+    COBSEndBlock(encoder);
+}
+
+// private function to COBS encode a block of bytes, adding them to a CRC
+static uint16_t COBSPutBlock(TCOBSEncoder* const encoder, uint16_t crc, const uint8_t* const data, const uint16_t nbBytes)
+{
+  for (uint16_t i = 0; i < nbBytes; i++)
+  {
+    crc = CRC16_Update(crc, data[i]);
+    COBSPut(encoder, data[i]);
+  }
+
+  return crc;
+}
+
+// private function to finish a COBS frame with its CRC and the zero delimiter, and send it
+static void COBSEnd(TCOBSEncoder* const encoder, const uint16_t crc)
+{
+  COBSPut(encoder, (uint8_t)crc);
+  COBSPut(encoder, (uint8_t)(crc >> 8));
+  FIFO_SpanWrite(&encoder->span, encoder->codePosition, encoder->code);
+  FIFO_SpanWrite(&encoder->span, encoder->position++, 0x00);
+
+  UART_PortOutCommit(encoder->port, encoder->position);
+}
+
+// private function to decode a received COBS frame in place, returning the decoded length or 0 if it is invalid
+static uint16_t COBSDecode(uint8_t* const frame, const uint16_t nbBytes)
+{
+  uint16_t read  = 0;
+  uint16_t write = 0;
+
+  while (read < nbBytes)
+  {
+    uint8_t code = frame[read++];
+
+    if ((code == 0) || (read + code - 1 > nbBytes))
+      return 0;
+
+    for (uint8_t i = 1; i < code; i++)
+      frame[write++] = frame[read++];
+
+    if ((code < 0xFF) && (read < nbBytes))
+      frame[write++] = 0x00;
+  }
+
+  return write;
+}
+
+// private function to check a decoded COBS frame and copy it into the link's packet and frame data
+static bool COBSAccept(TPacketLink* const link, const uint16_t length)
+{
+  // Command and CRC at the least, and no more data than frameData can hold
+  if ((length < 3) || (length > PACKET_COBS_MAX_DECODED))
+    return false;
+
+  uint16_t crc = link->rxFrame[length - 2] | (link->rxFrame[length - 1] << 8);
+
+  if (CRC16_Block(CRC16_INITIAL, link->rxFrame, length - 2) != crc)
+    return false;
+
+  link->frameLength = (uint8_t)(length - 3);
+
+  for (uint8_t i = 0; i < link->frameLength; i++)
+    link->frameData[i] = link->rxFrame[1 + i];
+
+  // Short frames are ordinary packets, so fill in the parameters for the packet handlers
+  TPacket* const packet = &link->packet;
+
+  PACKET_COMMAND(packet)    = link->rxFrame[0];
+  PACKET_PARAMETER1(packet) = (link->frameLength > 0) ? link->frameData[0] : 0;
+  PACKET_PARAMETER2(packet) = (link->frameLength > 1) ? link->frameData[1] : 0;
+  PACKET_PARAMETER3(packet) = (link->frameLength > 2) ? link->frameData[2] : 0;
+  packet->packetStruct.checksum = Checksum(PACKET_COMMAND(packet), PACKET_PARAMETER1(packet),
+                                           PACKET_PARAMETER2(packet), PACKET_PARAMETER3(packet));
+
+  return true;
+}
+
+// private function to empty the 5-byte receive window
+static void ResetWindow(TPacketLink* const link)
+{
+  link->packetIndex   = 0;
+  link->rxWindowStart = 0;
+  link->rxWindowXOR   = 0;
+  link->rxInSync      = true;
+}
+
+// private function to add received bytes to the COBS frame up to a zero byte, returning how many were used
+static uint16_t COBSScan(TPacketLink* const link, const uint8_t* const data, const uint16_t nbBytes, bool* const ended)
+{
+  const uint8_t* zero = memchr(data, 0x00, nbBytes);
+  uint16_t nbData     = (zero != NULL) ? (uint16_t)(zero - data) : nbBytes;
+  uint16_t room       = PACKET_COBS_MAX_ENCODED - link->rxFrameIndex;
+
+  if (nbData > room)
+  {
+    link->rxFrameOverflow = true;
+    memcpy(&link->rxFrame[link->rxFrameIndex], data, room);
+    link->rxFrameIndex += room;
+  }
+  else
+  {
+    memcpy(&link->rxFrame[link->rxFrameIndex], data, nbData);
+    link->rxFrameIndex += nbData;
+  }
+
+  *ended = (zero != NULL);
+  return *ended ? nbData + 1 : nbData;
+}
+
+// private function to decode and check a COBS frame once its zero byte has arrived
+static bool COBSFinish(TPacketLink* const link)
+{
+  // A zero byte always ends a frame, whether or not the frame is any good
+  uint16_t nbBytes = link->rxFrameIndex;
+  bool overflow    = link->rxFrameOverflow;
+
+  link->rxFrameIndex    = 0;
+  link->rxFrameOverflow = false;
+
+  if (!overflow && (nbBytes > 0) && COBSAccept(link, COBSDecode(link->rxFrame, nbBytes)))
+    return true;
+
+  if (overflow || (nbBytes > 0)) // back to back zero bytes are allowed, anything else is a bad frame
+    link->framingErrors++;
+
+  return false;
+}
+
+// private function to get a COBS frame from the received data, parsing it in place in the receive FIFO
+static bool GetCOBS(TPacketLink* const link)
+{
+  TFIFOSpan span;
+
+  while (UART_PortInPeek(link->port, &span) > 0)
+  {
+    bool ended;
+    uint16_t used = COBSScan(link, span.data1, span.length1, &ended);
+
+    if (!ended && (span.length2 > 0))
+      used += COBSScan(link, span.data2, span.length2, &ended);
+
+    UART_PortInConsume(link->port, used);
+
+    if (ended && COBSFinish(link))
+    {
+      link->rxStamp = UART_PortInStamp(link->port);
+      link->nbReceived++;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// private function to slide received bytes through the 5-byte window until it holds a packet, returning how many were used
+static uint16_t FixedScan(TPacketLink* const link, const uint8_t* const data, const uint16_t nbBytes, bool* const found)
+{
+  for (uint16_t i = 0; i < nbBytes; i++)
+  {
+    if (link->packetIndex < PACKET_NB_BYTES) // still filling the window
+    {
+      link->rxWindow[link->packetIndex++] = data[i];
+      link->rxWindowXOR ^= data[i];
+
+      if (link->packetIndex < PACKET_NB_BYTES)
+        continue;
+    }
+    else // out of sync: slide the window along by one byte
+    {
+      link->rxWindowXOR ^= link->rxWindow[link->rxWindowStart] ^ data[i];
+      link->rxWindow[link->rxWindowStart] = data[i];
+
+      if (++link->rxWindowStart == PACKET_NB_BYTES)
+        link->rxWindowStart = 0;
+    }
+
+    // The XOR of the command, parameters and checksum is zero for a good packet. While in sync any command
+    // is passed on so that an unknown one can be NAKed, but a resync also needs a command with a handler
+    if ((link->rxWindowXOR == 0) && (link->rxInSync || Packet_IsRegistered(link->rxWindow[link->rxWindowStart])))
+    {
+      uint8_t position = link->rxWindowStart;
+
+      for (uint8_t j = 0; j < PACKET_NB_BYTES; j++)
+      {
+        link->packet.bytes[j] = link->rxWindow[position];
+
+        if (++position == PACKET_NB_BYTES)
+          position = 0;
+      }
+
+      ResetWindow(link);
+      *found = true;
+      return i + 1;
+    }
+
+    if (link->rxInSync)
+    {
+      link->rxInSync = false;
+      link->framingErrors++;
+    }
+  }
+
+  *found = false;
+  return nbBytes;
+}
+
+// private function to get a 5-byte packet from the received data, parsing it in place in the receive FIFO
+static bool GetFixed(TPacketLink* const link)
+{
+  TFIFOSpan span;
+
+  while (UART_PortInPeek(link->port, &span) > 0)
+  {
+    bool found;
+    uint16_t used = FixedScan(link, span.data1, span.length1, &found);
+
+    if (!found && (span.length2 > 0))
+      used += FixedScan(link, span.data2, span.length2, &found);
+
+    UART_PortInConsume(link->port, used);
+
+    if (found)
+    {
+      link->rxStamp = UART_PortInStamp(link->port);
+      link->nbReceived++;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+
+/*! @brief Sets up a link and the UART it uses before first use.
+ *
+ *  The link starts with 5-byte packets and its statistics cleared.
+ *  @param link The link to set up.
+ *  @param port The UART to send and receive on.
+ *  @param baudRate The desired baud rate in bits/sec.
+ *  @param moduleClk The module clock rate of the UART in Hz.
+ *  @return bool - TRUE if the link was successfully initialized.
+ */
+bool Packet_LinkInit(TPacketLink* const link, TUARTPort* const port, const uint32_t baudRate, const uint32_t moduleClk)
+{
+  link->port            = port;
+  link->framing         = PACKET_FRAMING_FIXED;
+  link->rxFrameIndex    = 0;
+  link->rxFrameOverflow = false;
+  link->framingErrors   = 0;
+  link->nbReceived      = 0;
+  link->nbSent          = 0;
+  link->nbDropped       = 0;
+  ResetWindow(link);
+
+  return UART_PortInit(port, baudRate, moduleClk);
+}
+
+
+
+/*! @brief Selects how packets are framed on a link.
+ *
+ *  Any partly received packet is thrown away.
+ *  @param link The link.
+ *  @param framing The framing to use for all packets on the link from now on.
+ *  @return bool - TRUE if the framing is supported.
+ */
+bool Packet_LinkSetFraming(TPacketLink* const link, const TPacketFraming framing)
+{
+  if (framing > PACKET_FRAMING_COBS)
+    return false;
+
+  EnterCritical();
+  link->framing         = framing;
+  link->rxFrameIndex    = 0;
+  link->rxFrameOverflow = false;
+  ResetWindow(link);
+  ExitCritical();
+
+  return true;
+}
+
+
+
+/*! @brief Attempts to get a packet from the data received on a link.
+ *
+ *  With 5-byte packets, a packet is accepted if its checksum is good, so that an unknown command can be NAKed.
+ *  Otherwise the receiver is out of sync and slides along one byte at a time until it finds a good packet
+ *  whose command has a handler.
+ *
+ *  @param link The link.
+ *  @return bool - TRUE if a valid packet was received, which is in link->packet.
+ */
+bool Packet_LinkGet(TPacketLink* const link)
+{
+  if (link->framing == PACKET_FRAMING_COBS)
+    return GetCOBS(link);
+
+  return GetFixed(link);
+}
+
+
+
+/*! @brief Builds a packet and places it in the transmit FIFO buffer of a link.
+ *
+ *  @param link The link to send on.
+ *  @return bool - TRUE if a valid packet was sent.
+ */
+bool Packet_LinkPut(TPacketLink* const link, const uint8_t command, const uint8_t parameter1, const uint8_t parameter2, const uint8_t parameter3)
+{
+  TFIFOSpan span;
+  bool success;
+
+  if (link->framing == PACKET_FRAMING_COBS)
+  {
+    uint8_t packet[PACKET_NB_BYTES - 1] = {command, parameter1, parameter2, parameter3};
+    return Packet_LinkPutFrame(link, packet[0], &packet[1], PACKET_NB_BYTES - 2);
+  }
+
+  success = UART_PortOutReserve(link->port, PACKET_NB_BYTES, &span);
+
+  if (success)
+  {
+    uint8_t checksum = Checksum(command, parameter1, parameter2, parameter3);
+
+    if (span.length2 == 0) // usually the packet does not wrap around the end of the FIFO
+    {
+      span.data1[0] = command;
+      span.data1[1] = parameter1;
+      span.data1[2] = parameter2;
+      span.data1[3] = parameter3;
+      span.data1[4] = checksum;
+    }
+    else
+    {
+      FIFO_SpanWrite(&span, 0, command);
+      FIFO_SpanWrite(&span, 1, parameter1);
+      FIFO_SpanWrite(&span, 2, parameter2);
+      FIFO_SpanWrite(&span, 3, parameter3);
+      FIFO_SpanWrite(&span, 4, checksum);
+    }
+
+    UART_PortOutCommit(link->port, PACKET_NB_BYTES);
+    link->nbSent++;
+  }
+  else
+    link->nbDropped++;
+
+  return success;
+}
+
+
+
+/*! @brief Builds a variable length frame and places it in the transmit FIFO buffer of a link.
+ *
+ *  With fixed framing, the frame is the command, the number of data bytes, the data bytes and then
+ *  a checksum which is the XOR of all of the preceding bytes.
+ *  With COBS framing, the frame is the command, the data bytes and the CRC-16.
+ *  @param link The link to send on.
+ *  @param command The frame's command.
+ *  @param data The frame's data.
+ *  @param nbBytes The number of data bytes (up to PACKET_FRAME_MAX_BYTES).
+ *  @return bool - TRUE if the frame was sent.
+ */
+bool Packet_LinkPutFrame(TPacketLink* const link, const uint8_t command, const uint8_t* const data, const uint8_t nbBytes)
+{
+  uint8_t checksum = command ^ nbBytes;
+  TFIFOSpan span;
+  bool success;
+
+  // The whole frame is reserved up front, so a frame is either sent complete or not at all
+  if (link->framing == PACKET_FRAMING_COBS)
+  {
+    TCOBSEncoder encoder;
+    uint16_t crc;
+
+    success = COBSStart(&encoder, link->port, 1 + nbBytes + 2);
+
+    if (success)
+    {
+      crc = COBSPutBlock(&encoder, CRC16_INITIAL, &command, 1);
+      crc = COBSPutBlock(&encoder, crc, data, nbBytes);
+      COBSEnd(&encoder, crc);
+    }
+  }
+  else
+  {
+    success = UART_PortOutReserve(link->port, nbBytes + 3, &span);
+
+    if (success)
+    {
+      for (uint8_t i = 0; i < nbBytes; i++)
+        checksum ^= data[i];
+
+      FIFO_SpanWrite(&span, 0, command);
+      FIFO_SpanWrite(&span, 1, nbBytes);
+      FIFO_SpanCopy(&span, 2, data, nbBytes);
+      FIFO_SpanWrite(&span, nbBytes + 2, checksum);
+      UART_PortOutCommit(link->port, nbBytes + 3);
+    }
+  }
+
+  if (success)
+    link->nbSent++;
+  else
+    link->nbDropped++;
+
+  return success;
+}
+
+
+
+/*! @brief Initializes the packets by calling the initialization routines of the supporting software modules.
+ *
+ *  @param baudRate The desired baud rate in bits/sec.
+ *  @param moduleClk The module clock rate in Hz.
+ *  @return bool - TRUE if the packet module was successfully initialized.
+ */
+bool Packet_Init(const uint32_t baudRate, const uint32_t moduleClk)
+{
+  return Packet_LinkInit(&Packet_ControlLink, &UART_Port2, baudRate, moduleClk);
+}
+
+
+
+/*! @brief Selects how packets are framed on the serial port.
+ *
+ *  Any partly received packet is thrown away.
+ *  @param framing The framing to use for all packets from now on.
+ *  @return bool - TRUE if the framing is supported.
+ */
+bool Packet_SetFraming(const TPacketFraming framing)
+{
+  return Packet_LinkSetFraming(&Packet_ControlLink, framing);
+}
+
+
+
+/*! @brief Gets the current framing.
+ *
+ *  @return TPacketFraming - The framing used for packets.
+ */
+TPacketFraming Packet_GetFraming(void)
+{
+  return Packet_ControlLink.framing;
+}
+
+
+
+/*! @brief Attempts to get a packet from the received data.
+ *
+ *  @return bool - TRUE if a valid packet was received.
+ */
+bool Packet_Get(void)
+{
+  return Packet_LinkGet(&Packet_ControlLink);
+}
+
+
+
+/*! @brief Builds a packet and places it in the transmit FIFO buffer.
+ *
+ *  @return bool - TRUE if a valid packet was sent.
+ */
+bool Packet_Put(const uint8_t command, const uint8_t parameter1, const uint8_t parameter2, const uint8_t parameter3)
+{
+  return Packet_LinkPut(&Packet_ControlLink, command, parameter1, parameter2, parameter3);
+}
+
+
+
+/*! @brief Builds a variable length frame and places it in the transmit FIFO buffer.
+ *
+ *  @param command The frame's command.
+ *  @param data The frame's data.
+ *  @param nbBytes The number of data bytes (up to PACKET_FRAME_MAX_BYTES).
+ *  @return bool - TRUE if the frame was sent.
+ */
+bool Packet_PutFrame(const uint8_t command, const uint8_t* const data, const uint8_t nbBytes)
+{
+  return Packet_LinkPutFrame(&Packet_ControlLink, command, data, nbBytes);
+}
+
+
+
+/*! @brief Registers the function that handles a command.
+ *
+ *  @param command The command, without the ACK bit.
+ *  @param handler The function to call for packets with this command, or NULL to remove the handler.
+ *  @return bool - TRUE if the handler was registered.
+ */
+bool Packet_RegisterHandler(const uint8_t command, const TPacketHandler handler)
+{
+  if (command >= PACKET_NB_COMMANDS)
+    return false;
+
+  Handlers[command] = handler;
+  return true;
+}
+
+
+
+/*! @brief Checks whether a command has a handler.
+ *
+ *  @param command The command, with or without the ACK bit.
+ *  @return bool - TRUE if a handler is registered for the command.
+ */
+bool Packet_IsRegistered(const uint8_t command)
+{
+  return (Handlers[command & ~PACKET_ACK_MASK] != NULL);
+}
+
+
+
+/*! @brief Passes a packet to the handler registered for its command.
+ *
+ *  @param packet The packet to handle. The ACK bit of its command is ignored.
+ *  @return bool - TRUE if there is a handler for the command and it succeeded.
+ */
+bool Packet_Handle(const TPacket* const packet)
+{
+  TPacketHandler handler = Handlers[PACKET_COMMAND(packet) & ~PACKET_ACK_MASK];
+
+  if (handler == NULL)
+    return false;
+
+  return handler(packet);
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,147 @@
+/*! @file
+ *
+ *  @brief Ring buffers of fixed-size records.
+ *
+ *  This contains the functions for passing whole records, such as timestamped samples or events,
+ *  from one writer to one reader (e.g. an ISR and the main loop) without disabling interrupts.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-26
+ */
+/*!
+**  @addtogroup main_module main module documentation
+**
+**  @author Thanit Tangson
+**  @{
+*/
+
+/*
+
+The same scheme as the byte FIFO (see FIFO.c), a record at a time: start and end run freely and
+are masked to find a record's position, so the reader never sees a record until all of it has been
+written, and a record is never overwritten before the reader has copied all of it out.
+
+*/
+
+#include "ring.h"
+
+// memcpy for copying records
+#include <string.h>
+
+// Needed for the defintion of NULL pointer
+#include "PE_Types.h"
+
+// Stops the compiler moving accesses to the records past an update of start or end
+#define RING_BARRIER() __asm volatile ("" ::: "memory")
+
+/*! @brief Sets up a ring before first use and empties it.
+ *
+ *  @param ring A pointer to the ring to initialize.
+ *  @param storage Space for nbRecords records.
+ *  @param recordSize The number of bytes in a record.
+ *  @param nbRecords The number of records the ring holds, which must be a power of 2 (2 to 32768).
+ *  @return bool - TRUE if the ring was successfully initialized.
+ */
+bool Ring_Init(TRing* const ring, void* const storage, const uint16_t recordSize, const uint16_t nbRecords)
+{
+  if ((storage == NULL) || (recordSize == 0) || (nbRecords < 2) || (nbRecords > 32768) || (nbRecords & (nbRecords - 1)))
+    return false;
+
+  ring->start      = 0;
+  ring->end        = 0;
+  ring->mask       = nbRecords - 1;
+  ring->recordSize = recordSize;
+  ring->records    = storage;
+  Ring_ResetStats(ring);
+  return true;
+}
+
+
+
+/*! @brief Gets the number of records in the ring.
+ *
+ *  @param ring A pointer to the ring.
+ *  @return uint16_t - The number of records waiting to be read.
+ */
+uint16_t Ring_Count(const TRing* const ring)
+{
+  return (uint16_t)(ring->end - ring->start);
+}
+
+
+
+/*! @brief Clears the usage statistics of the ring, with the peak starting again at the current count.
+ *
+ *  @param ring A pointer to the ring.
+ */
+void Ring_ResetStats(TRing* const ring)
+{
+  ring->stats.peak        = Ring_Count(ring);
+  ring->stats.nbIn        = 0;
+  ring->stats.nbOut       = 0;
+  ring->stats.nbOverflows = 0;
+  ring->stats.nbEmptyGets = 0;
+}
+
+
+
+/*! @brief Copies a record into the ring if it is not full.
+ *
+ *  @param ring A pointer to the ring.
+ *  @param record The record to add, recordSize bytes long.
+ *  @return bool - TRUE if the record was added.
+ *  @note Assumes that Ring_Init has been called.
+ */
+bool Ring_Put(TRing* const ring, const void* const record)
+{
+  uint16_t end = ring->end;
+
+  uint16_t count = (uint16_t)(end - ring->start);
+
+  if (count > ring->mask)
+  {
+    ring->stats.nbOverflows++;
+    return false;
+  }
+
+  memcpy(&ring->records[(uint32_t)(end & ring->mask) * ring->recordSize], record, ring->recordSize);
+  RING_BARRIER();
+  ring->end = end + 1;
+
+  ring->stats.nbIn++;
+
+  if (count + 1 > ring->stats.peak)
+    ring->stats.peak = count + 1;
+
+  return true;
+}
+
+
+
+/*! @brief Copies the oldest record out of the ring if it is not empty.
+ *
+ *  @param ring A pointer to the ring.
+ *  @param record Where to copy the record, recordSize bytes long.
+ *  @return bool - TRUE if a record was retrieved.
+ *  @note Assumes that Ring_Init has been called.
+ */
+bool Ring_Get(TRing* const ring, void* const record)
+{
+  uint16_t start = ring->start;
+
+  if (ring->end == start)
+  {
+    ring->stats.nbEmptyGets++;
+    return false;
+  }
+
+  memcpy(record, &ring->records[(uint32_t)(start & ring->mask) * ring->recordSize], ring->recordSize);
+  RING_BARRIER();
+  ring->start = start + 1;
+  ring->stats.nbOut++;
+  return true;
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,79 @@
+/*! @file
+ *
+ *  @brief Ring buffers of fixed-size records.
+ *
+ *  This contains the functions for passing whole records, such as timestamped samples or events,
+ *  from one writer to one reader (e.g. an ISR and the main loop) without disabling interrupts.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-26
+ */
+
+#ifndef RING_H
+#define RING_H
+
+// New types
+#include "types.h"
+
+// The same usage statistics as the byte FIFOs, counted in records
+#include "FIFO.h"
+
+/*!
+ * @struct TRing
+ */
+typedef struct
+{
+  uint16_t volatile start;	/*!< The free-running index of the oldest record, only changed by the reader */
+  uint16_t volatile end;	/*!< The free-running index of the next empty record, only changed by the writer */
+  uint16_t mask;		/*!< The number of records the ring holds minus 1, to turn an index into a position */
+  uint16_t recordSize;		/*!< The number of bytes in a record */
+  uint8_t* records;		/*!< The storage for the records */
+  TFIFOStats stats;		/*!< How the ring has been used, in records */
+} TRing;
+
+// Sets up a ring in an array of records, taking the record size and number of records from the array's type
+#define RING_INIT(ring, storage) \
+  Ring_Init((ring), (storage), sizeof((storage)[0]), sizeof(storage) / sizeof((storage)[0]))
+
+/*! @brief Sets up a ring before first use and empties it.
+ *
+ *  @param ring A pointer to the ring to initialize.
+ *  @param storage Space for nbRecords records.
+ *  @param recordSize The number of bytes in a record.
+ *  @param nbRecords The number of records the ring holds, which must be a power of 2 (2 to 32768).
+ *  @return bool - TRUE if the ring was successfully initialized.
+ */
+bool Ring_Init(TRing* const ring, void* const storage, const uint16_t recordSize, const uint16_t nbRecords);
+
+/*! @brief Gets the number of records in the ring.
+ *
+ *  @param ring A pointer to the ring.
+ *  @return uint16_t - The number of records waiting to be read.
+ */
+uint16_t Ring_Count(const TRing* const ring);
+
+/*! @brief Clears the usage statistics of the ring, with the peak starting again at the current count.
+ *
+ *  @param ring A pointer to the ring.
+ */
+void Ring_ResetStats(TRing* const ring);
+
+/*! @brief Copies a record into the ring if it is not full.
+ *
+ *  @param ring A pointer to the ring.
+ *  @param record The record to add, recordSize bytes long.
+ *  @return bool - TRUE if the record was added.
+ *  @note Assumes that Ring_Init has been called.
+ */
+bool Ring_Put(TRing* const ring, const void* const record);
+
+/*! @brief Copies the oldest record out of the ring if it is not empty.
+ *
+ *  @param ring A pointer to the ring.
+ *  @param record Where to copy the record, recordSize bytes long.
+ *  @return bool - TRUE if a record was retrieved.
+ *  @note Assumes that Ring_Init has been called.
+ */
+bool Ring_Get(TRing* const ring, void* const record);
+
+#endif
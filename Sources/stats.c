@@ -0,0 +1,191 @@
+/*! @file stats.c
+ *
+ *  @brief Sliding window statistics for accelerometer data.
+ *
+ *  This contains the functions for keeping the mean, variance, RMS, minimum and maximum
+ *  of the last N XYZ samples up to date in constant time per sample.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-18
+ */
+/*!
+**  @addtogroup main_module main module documentation
+**
+**  @author Thanit Tangson
+**  @{
+*/
+
+/*
+
+The sum and sum of squares are updated by adding the new sample and subtracting the one that drops out.
+The minimum and maximum use monotonic deques: a sample can never be the maximum while a newer, larger
+sample is in the window, so it is thrown away as soon as that sample arrives. The front of each deque is
+then always the answer, and each sample is pushed and popped at most once (amortised O(1) per sample).
+
+The deques hold ring positions rather than values, so the oldest sample can be recognised at the front
+when it drops out of the window. With at most 256 samples a position fits in a byte and the deque
+indices wrap around by themselves.
+
+*/
+
+#include "stats.h"
+
+// private function to add one sample of one axis to the window
+static void PutAxis(TStatsAxis* const axis, const uint8_t position, const bool full, const int8_t value)
+{
+  // Drop the oldest sample, which is about to be overwritten
+  if (full)
+  {
+    int8_t old = axis->samples[position];
+
+    axis->sum        -= old;
+    axis->sumSquares -= (uint32_t)(old * old);
+
+    if (axis->maxCount && (axis->maxDeque[axis->maxFront] == position))
+    {
+      axis->maxFront++;
+      axis->maxCount--;
+    }
+
+    if (axis->minCount && (axis->minDeque[axis->minFront] == position))
+    {
+      axis->minFront++;
+      axis->minCount--;
+    }
+  }
+
+  axis->samples[position] = value;
+  axis->sum              += value;
+  axis->sumSquares       += (uint32_t)(value * value);
+
+  // Older samples that are no bigger (no smaller) than the new one can never be the maximum (minimum) again
+  while (axis->maxCount && (axis->samples[axis->maxDeque[(uint8_t)(axis->maxFront + axis->maxCount - 1)]] <= value))
+    axis->maxCount--;
+  axis->maxDeque[(uint8_t)(axis->maxFront + axis->maxCount)] = position;
+  axis->maxCount++;
+
+  while (axis->minCount && (axis->samples[axis->minDeque[(uint8_t)(axis->minFront + axis->minCount - 1)]] >= value))
+    axis->minCount--;
+  axis->minDeque[(uint8_t)(axis->minFront + axis->minCount)] = position;
+  axis->minCount++;
+}
+
+
+
+/*! @brief Sets up the statistics window before first use and empties it.
+ *
+ *  @param stats A pointer to the statistics to initialize.
+ *  @param windowSize The number of samples to keep statistics over (1 to STATS_MAX_WINDOW).
+ *  @return bool - TRUE if the statistics were successfully initialized.
+ */
+bool Stats_Init(TStats* const stats, const uint16_t windowSize)
+{
+  if ((windowSize == 0) || (windowSize > STATS_MAX_WINDOW))
+    return false;
+
+  stats->windowSize = windowSize;
+  stats->nbSamples  = 0;
+  stats->position   = 0;
+
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    stats->axes[i].sum        = 0;
+    stats->axes[i].sumSquares = 0;
+    stats->axes[i].maxFront   = 0;
+    stats->axes[i].minFront   = 0;
+    stats->axes[i].maxCount   = 0;
+    stats->axes[i].minCount   = 0;
+  }
+
+  return true;
+}
+
+
+
+/*! @brief Adds a block of XYZ samples to the window, dropping the oldest samples once it is full.
+ *
+ *  @param stats A pointer to the statistics.
+ *  @param data nbSamples samples from the accelerometer, oldest first.
+ *  @param nbSamples The number of samples to add.
+ *  @note Assumes that Stats_Init has been called.
+ */
+void Stats_PutBlock(TStats* const stats, const TAccelData* const data, const uint16_t nbSamples)
+{
+  for (uint16_t n = 0; n < nbSamples; n++)
+  {
+    bool full = (stats->nbSamples == stats->windowSize);
+
+    for (uint8_t i = 0; i < 3; i++)
+      PutAxis(&stats->axes[i], (uint8_t)stats->position, full, (int8_t)data[n].bytes[i]);
+
+    if (!full)
+      stats->nbSamples++;
+
+    stats->position++;
+    if (stats->position == stats->windowSize)
+      stats->position = 0;
+  }
+}
+
+
+
+/*! @brief Gets the statistics of one axis over the current window.
+ *
+ *  @param stats A pointer to the statistics.
+ *  @param axis 0, 1 or 2 for X, Y or Z.
+ *  @param result A pointer to where the statistics are stored.
+ *  @return bool - TRUE if the window had samples in it and the axis was valid.
+ *  @note Assumes that Stats_Init has been called.
+ */
+bool Stats_Get(const TStats* const stats, const uint8_t axis, TStatsResult* const result)
+{
+  if ((axis > 2) || (stats->nbSamples == 0))
+    return false;
+
+  const TStatsAxis* const a = &stats->axes[axis];
+  const int32_t n           = stats->nbSamples;
+
+  // variance = (n * sum(x^2) - sum(x)^2) / n^2, scaled by 256 before dividing to keep 8 fractional bits
+  int64_t spread = (int64_t)n * a->sumSquares - (int64_t)a->sum * a->sum;
+
+  result->mean     = (int16_t)((a->sum * 256) / n);
+  result->variance = (uint32_t)((spread * 256) / ((int64_t)n * n));
+  result->rms      = Stats_Sqrt((uint32_t)(((uint64_t)a->sumSquares << 16) / (uint32_t)n)); // mean square is at most 2^14, so this fits
+  result->max      = a->samples[a->maxDeque[a->maxFront]];
+  result->min      = a->samples[a->minDeque[a->minFront]];
+
+  return true;
+}
+
+/*! @brief Calculates an integer square root.
+ *
+ *  @param value The value to take the square root of.
+ *  @return uint16_t - The square root of value, rounded down.
+ */
+uint16_t Stats_Sqrt(uint32_t value)
+{
+  uint32_t root = 0;
+  uint32_t bit  = 1UL << 30;
+
+  while (bit > value)
+    bit >>= 2;
+
+  while (bit != 0)
+  {
+    if (value >= root + bit)
+    {
+      value -= root + bit;
+      root   = (root >> 1) + bit;
+    }
+    else
+      root >>= 1;
+
+    bit >>= 2;
+  }
+
+  return (uint16_t)root;
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,97 @@
+/*! @file
+ *
+ *  @brief Sliding window statistics for accelerometer data.
+ *
+ *  This contains the functions for keeping the mean, variance, RMS, minimum and maximum
+ *  of the last N XYZ samples up to date in constant time per sample.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-18
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+// New types
+#include "types.h"
+
+// Accelerometer data type
+#include "accel.h"
+
+// Largest window allowed, in samples (positions in the window must fit in a byte)
+#define STATS_MAX_WINDOW 256
+
+/*!
+ * @struct TStatsAxis
+ */
+typedef struct
+{
+  int32_t sum;				/*!< The sum of the samples in the window */
+  uint32_t sumSquares;			/*!< The sum of the squares of the samples in the window */
+  int8_t samples[STATS_MAX_WINDOW];	/*!< The samples in the window, stored in a ring */
+  uint8_t maxDeque[STATS_MAX_WINDOW];	/*!< Ring positions of the candidates for the maximum, values decreasing */
+  uint8_t minDeque[STATS_MAX_WINDOW];	/*!< Ring positions of the candidates for the minimum, values increasing */
+  uint8_t maxFront;			/*!< The index of the oldest maximum candidate */
+  uint8_t minFront;			/*!< The index of the oldest minimum candidate */
+  uint16_t maxCount;			/*!< The number of maximum candidates */
+  uint16_t minCount;			/*!< The number of minimum candidates */
+} TStatsAxis;
+
+/*!
+ * @struct TStats
+ */
+typedef struct
+{
+  uint16_t windowSize;			/*!< The number of samples the statistics are taken over */
+  uint16_t nbSamples;			/*!< The number of samples currently in the window */
+  uint16_t position;			/*!< The ring position the next sample is written to */
+  TStatsAxis axes[3];			/*!< The window for each of X, Y and Z */
+} TStats;
+
+/*!
+ * @struct TStatsResult
+ */
+typedef struct
+{
+  int16_t mean;				/*!< The mean, in 1/256ths of an LSB */
+  uint32_t variance;			/*!< The variance, in 1/256ths of an LSB squared */
+  uint16_t rms;				/*!< The root mean square, in 1/256ths of an LSB */
+  int8_t min;				/*!< The smallest sample in the window */
+  int8_t max;				/*!< The largest sample in the window */
+} TStatsResult;
+
+/*! @brief Sets up the statistics window before first use and empties it.
+ *
+ *  @param stats A pointer to the statistics to initialize.
+ *  @param windowSize The number of samples to keep statistics over (1 to STATS_MAX_WINDOW).
+ *  @return bool - TRUE if the statistics were successfully initialized.
+ */
+bool Stats_Init(TStats* const stats, const uint16_t windowSize);
+
+/*! @brief Adds a block of XYZ samples to the window, dropping the oldest samples once it is full.
+ *
+ *  @param stats A pointer to the statistics.
+ *  @param data nbSamples samples from the accelerometer, oldest first.
+ *  @param nbSamples The number of samples to add.
+ *  @note Assumes that Stats_Init has been called.
+ */
+void Stats_PutBlock(TStats* const stats, const TAccelData* const data, const uint16_t nbSamples);
+
+/*! @brief Gets the statistics of one axis over the current window.
+ *
+ *  @param stats A pointer to the statistics.
+ *  @param axis 0, 1 or 2 for X, Y or Z.
+ *  @param result A pointer to where the statistics are stored.
+ *  @return bool - TRUE if the window had samples in it and the axis was valid.
+ *  @note Assumes that Stats_Init has been called.
+ */
+bool Stats_Get(const TStats* const stats, const uint8_t axis, TStatsResult* const result);
+
+/*! @brief Calculates an integer square root.
+ *
+ *  @param value The value to take the square root of.
+ *  @return uint16_t - The square root of value, rounded down.
+ */
+uint16_t Stats_Sqrt(uint32_t value);
+
+#endif
@@ -0,0 +1,117 @@
+/*! @file
+ *
+ *  @brief Data streams with credit-based flow control.
+ *
+ *  This contains the functions for deciding when a sample of a stream the PC has subscribed to
+ *  is sent: at a fraction of the data rate, only while the PC has granted credits for it, and only
+ *  if it leaves room in the transmit FIFO for replies to commands.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-25
+ */
+/*!
+**  @addtogroup main_module main module documentation
+**
+**  @author Thanit Tangson
+**  @{
+*/
+
+/*
+
+Without flow control the tower sends as fast as the data arrives, and once the transmit FIFO is full
+Packet_Put fails for everything, replies to commands included. With a subscription, the PC grants
+credits for as many samples as it is ready to take and tops them up as they arrive, so the stream can
+never get further ahead of the PC than it allows. Samples that are due but can not be sent are counted
+rather than queued, so the PC can tell how much it missed.
+
+*/
+
+#include "stream.h"
+
+// The transmit FIFO of the stream's UART is checked for room
+#include "UART.h"
+
+/*! @brief Sets up a stream before first use, with nothing subscribed.
+ *
+ *  @param stream A pointer to the stream to initialize.
+ *  @param port The UART the stream is sent on.
+ */
+void Stream_Init(TStream* const stream, TUARTPort* const port)
+{
+  stream->port = port;
+  (void)Stream_Subscribe(stream, STREAM_OFF, 1);
+}
+
+
+
+/*! @brief Changes what a stream sends, and clears its credits and counters.
+ *
+ *  @param stream A pointer to the stream.
+ *  @param source What to send.
+ *  @param divider Send one sample in this many (1 to 255).
+ *  @return bool - TRUE if the subscription is valid.
+ */
+bool Stream_Subscribe(TStream* const stream, const TStreamSource source, const uint8_t divider)
+{
+  if ((source > STREAM_STATS) || (divider == 0))
+    return false;
+
+  stream->source    = source;
+  stream->divider   = divider;
+  stream->count     = 0;
+  stream->credits   = 0;
+  stream->dropped   = 0;
+  stream->decimated = 0;
+  return true;
+}
+
+
+
+/*! @brief Adds to the number of samples the PC is ready to receive.
+ *
+ *  @param stream A pointer to the stream.
+ *  @param credits The number of samples to add, the total being limited to 65535.
+ */
+void Stream_Grant(TStream* const stream, const uint16_t credits)
+{
+  uint32_t total = (uint32_t)stream->credits + credits;
+
+  stream->credits = (total > 0xFFFF) ? 0xFFFF : (uint16_t)total;
+}
+
+
+
+/*! @brief Decides whether to send the latest sample of a stream, and if so uses up a credit.
+ *
+ *  @param stream A pointer to the stream.
+ *  @param nbPackets The number of 5-byte packets needed to send the sample.
+ *  @return bool - TRUE if the sample should be sent now.
+ *  @note Call once for each new sample from the stream's source.
+ */
+bool Stream_Take(TStream* const stream, const uint8_t nbPackets)
+{
+  if (stream->source == STREAM_OFF)
+    return false;
+
+  if (++stream->count < stream->divider)
+  {
+    stream->decimated++;
+    return false;
+  }
+
+  stream->count = 0;
+
+  if ((stream->credits == 0) ||
+      (UART_PortOutSpace(stream->port) < (uint16_t)nbPackets * STREAM_PACKET_BYTES + STREAM_TX_RESERVE))
+  {
+    stream->dropped++;
+    return false;
+  }
+
+  stream->credits--;
+  return true;
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,82 @@
+/*! @file
+ *
+ *  @brief Data streams with credit-based flow control.
+ *
+ *  This contains the functions for deciding when a sample of a stream the PC has subscribed to
+ *  is sent: at a fraction of the data rate, only while the PC has granted credits for it, and only
+ *  if it leaves room in the transmit FIFO for replies to commands.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-25
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+// New types
+#include "types.h"
+
+// Streams are sent on a UART port
+#include "UART.h"
+
+// Bytes kept free in the transmit FIFO for replies to commands
+#define STREAM_TX_RESERVE 64
+
+// Most bytes a 5-byte packet takes in the transmit FIFO, which is with COBS framing
+#define STREAM_PACKET_BYTES 8
+
+typedef enum
+{
+  STREAM_OFF,			/*!< Nothing is sent. */
+  STREAM_RAW,			/*!< Accelerometer data straight from the accelerometer. */
+  STREAM_FILTERED,		/*!< Median filtered and decimated accelerometer data. */
+  STREAM_STATS			/*!< Sliding window statistics of all 3 axes. */
+} TStreamSource;
+
+/*!
+ * @struct TStream
+ */
+typedef struct
+{
+  TStreamSource source;		/*!< What is being streamed */
+  uint8_t divider;		/*!< One sample in this many is sent */
+  uint8_t count;		/*!< Samples since the last one that was due */
+  uint16_t credits;		/*!< Samples the PC is ready to receive */
+  uint32_t dropped;		/*!< Due samples not sent for lack of credits or room in the transmit FIFO */
+  uint32_t decimated;		/*!< Samples skipped by the divider */
+  TUARTPort* port;		/*!< The UART the stream is sent on, whose transmit FIFO is checked for room */
+} TStream;
+
+/*! @brief Sets up a stream before first use, with nothing subscribed.
+ *
+ *  @param stream A pointer to the stream to initialize.
+ *  @param port The UART the stream is sent on.
+ */
+void Stream_Init(TStream* const stream, TUARTPort* const port);
+
+/*! @brief Changes what a stream sends, and clears its credits and counters.
+ *
+ *  @param stream A pointer to the stream.
+ *  @param source What to send.
+ *  @param divider Send one sample in this many (1 to 255).
+ *  @return bool - TRUE if the subscription is valid.
+ */
+bool Stream_Subscribe(TStream* const stream, const TStreamSource source, const uint8_t divider);
+
+/*! @brief Adds to the number of samples the PC is ready to receive.
+ *
+ *  @param stream A pointer to the stream.
+ *  @param credits The number of samples to add, the total being limited to 65535.
+ */
+void Stream_Grant(TStream* const stream, const uint16_t credits);
+
+/*! @brief Decides whether to send the latest sample of a stream, and if so uses up a credit.
+ *
+ *  @param stream A pointer to the stream.
+ *  @param nbPackets The number of 5-byte packets needed to send the sample.
+ *  @return bool - TRUE if the sample should be sent now.
+ *  @note Call once for each new sample from the stream's source.
+ */
+bool Stream_Take(TStream* const stream, const uint8_t nbPackets);
+
+#endif
@@ -0,0 +1,118 @@
+/*! @file tilt.c
+ *
+ *  @brief Tilt angles from accelerometer data.
+ *
+ *  This contains the functions for turning XYZ accelerations into pitch and roll angles
+ *  using an integer CORDIC, without any floating point or maths library.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-20
+ */
+/*!
+**  @addtogroup main_module main module documentation
+**
+**  @author Thanit Tangson
+**  @{
+*/
+
+/*
+
+CORDIC in vectoring mode rotates (x, y) onto the x axis by a fixed sequence of angles atan(2^-i),
+each of which only needs shifts and adds. The angles used add up to atan2(y, x), and x ends up as
+the length of the vector times the CORDIC gain K (about 1.647).
+
+Angles are kept as binary angles (65536 per turn) while iterating and converted to tenths of a
+degree at the end. 14 iterations give about 0.01 degree resolution, finer than 8-bit data can use.
+
+*/
+
+#include "tilt.h"
+
+// Needed for the defintion of NULL pointer
+#include "PE_Types.h"
+
+#define TILT_NB_ITERATIONS 14
+#define TILT_HALF_TURN     32768L	/*!< 180 degrees as a binary angle. */
+#define TILT_GAIN_Q14      26981L	/*!< The CORDIC gain K in Q14. */
+
+// atan(2^-i) as binary angles
+static const int32_t TILT_ATAN[TILT_NB_ITERATIONS] =
+{
+  8192, 4836, 2555, 1297, 651, 326, 163, 81, 41, 20, 10, 5, 3, 1
+};
+
+
+
+/*! @brief Calculates the angle of the vector (x, y) from the x axis.
+ *
+ *  @param y The y component, with |y| < 2^17 so the iterations cannot overflow.
+ *  @param x The x component, with |x| < 2^17.
+ *  @param magnitude If not NULL, where the length of (x, y) multiplied by the CORDIC gain (about 1.647) is stored.
+ *  @return int16_t - The angle in tenths of a degree (-1800 to 1800).
+ */
+int16_t Tilt_Atan2(const int32_t y, const int32_t x, uint32_t* const magnitude)
+{
+  // Scale up so the shifts in the later iterations still have bits to work with
+  int32_t xi    = x << 12;
+  int32_t yi    = y << 12;
+  int32_t angle = 0;
+
+  // CORDIC only converges for -90 to 90 degrees, so rotate the left half plane by 180 degrees first
+  if (xi < 0)
+  {
+    xi    = -xi;
+    yi    = -yi;
+    angle = (yi > 0) ? -TILT_HALF_TURN : TILT_HALF_TURN;
+  }
+
+  for (uint8_t i = 0; i < TILT_NB_ITERATIONS; i++)
+  {
+    int32_t xOld = xi;
+
+    if (yi > 0) // rotate clockwise
+    {
+      xi    += yi >> i;
+      yi    -= xOld >> i;
+      angle += TILT_ATAN[i];
+    }
+    else // rotate anticlockwise
+    {
+      xi    -= yi >> i;
+      yi    += xOld >> i;
+      angle -= TILT_ATAN[i];
+    }
+  }
+
+  if (magnitude != NULL)
+    *magnitude = ((uint32_t)xi + 2048) >> 12; // rounded
+
+  // Binary angle -> tenths of a degree, rounded
+  return (int16_t)((angle * 3600 + (angle >= 0 ? 32768 : -32768)) / 65536);
+}
+
+
+
+/*! @brief Calculates pitch and roll from one XYZ sample.
+ *
+ *  pitch = atan2(-x, sqrt(y^2 + z^2)) and roll = atan2(y, z), which are only valid while the
+ *  accelerometer is mostly measuring gravity.
+ *  @param data The XYZ accelerations.
+ *  @param tilt A pointer to where the angles are stored.
+ */
+void Tilt_Get(const TAccelData* const data, TTilt* const tilt)
+{
+  // Scaled up by 256 so the magnitude of y and z keeps enough fractional bits for the pitch
+  int32_t x = (int8_t)data->axes.x * 256;
+  int32_t y = (int8_t)data->axes.y * 256;
+  int32_t z = (int8_t)data->axes.z * 256;
+  uint32_t yzMagnitude;
+
+  tilt->roll = Tilt_Atan2(y, z, &yzMagnitude);
+
+  // The magnitude from the roll CORDIC is sqrt(y^2 + z^2) * K, so scale -x by K to match instead of taking a square root
+  tilt->pitch = Tilt_Atan2((-x * TILT_GAIN_Q14 + 8192) >> 14, (int32_t)yzMagnitude, NULL);
+}
+
+/*!
+** @}
+*/
@@ -0,0 +1,48 @@
+/*! @file
+ *
+ *  @brief Tilt angles from accelerometer data.
+ *
+ *  This contains the functions for turning XYZ accelerations into pitch and roll angles
+ *  using an integer CORDIC, without any floating point or maths library.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-20
+ */
+
+#ifndef TILT_H
+#define TILT_H
+
+// New types
+#include "types.h"
+
+// Accelerometer data type
+#include "accel.h"
+
+/*!
+ * @struct TTilt
+ */
+typedef struct
+{
+  int16_t pitch;		/*!< Rotation about the Y axis in tenths of a degree (-900 to 900) */
+  int16_t roll;			/*!< Rotation about the X axis in tenths of a degree (-1800 to 1800) */
+} TTilt;
+
+/*! @brief Calculates the angle of the vector (x, y) from the x axis.
+ *
+ *  @param y The y component, with |y| < 2^17 so the iterations cannot overflow.
+ *  @param x The x component, with |x| < 2^17.
+ *  @param magnitude If not NULL, where the length of (x, y) multiplied by the CORDIC gain (about 1.647) is stored.
+ *  @return int16_t - The angle in tenths of a degree (-1800 to 1800).
+ */
+int16_t Tilt_Atan2(const int32_t y, const int32_t x, uint32_t* const magnitude);
+
+/*! @brief Calculates pitch and roll from one XYZ sample.
+ *
+ *  pitch = atan2(-x, sqrt(y^2 + z^2)) and roll = atan2(y, z), which are only valid while the
+ *  accelerometer is mostly measuring gravity.
+ *  @param data The XYZ accelerations.
+ *  @param tilt A pointer to where the angles are stored.
+ */
+void Tilt_Get(const TAccelData* const data, TTilt* const tilt);
+
+#endif
@@ -0,0 +1,18 @@
+/*! @file
+ *
+ *  @brief Stand-in for the Processor Expert CPU header when building tower modules on a PC.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-24
+ */
+
+#ifndef __Cpu_H
+#define __Cpu_H
+
+#include "PE_Types.h"
+
+// Same clocks as the tower, for code that scales by them
+#define CPU_BUS_CLK_HZ  25000000U
+#define CPU_CORE_CLK_HZ 50000000U
+
+#endif
@@ -0,0 +1,27 @@
+/*! @file
+ *
+ *  @brief Stand-in for the Processor Expert types header when building tower modules on a PC.
+ *
+ *  The host tools are single threaded and have no interrupts, so critical sections do nothing.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-24
+ */
+
+#ifndef __PE_Types_H
+#define __PE_Types_H
+
+#include <stddef.h>
+#include "types.h"
+
+#ifndef FALSE
+  #define FALSE 0x00u
+#endif
+#ifndef TRUE
+  #define TRUE  0x01u
+#endif
+
+#define EnterCritical() do {} while (0)
+#define ExitCritical()  do {} while (0)
+
+#endif
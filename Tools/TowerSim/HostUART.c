@@ -0,0 +1,527 @@
+/*! @file
+ *
+ *  @brief Simulated UART for building the packet layer on a PC.
+ *
+ *  This contains the functions for moving bytes between the UART FIFOs and a file descriptor
+ *  (a pty or serial port), at a simulated baud rate.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-24
+ */
+
+#define _GNU_SOURCE
+
+#include "HostUART.h"
+
+// Receive and transmit buffers, the same as on the tower
+#include "FIFO.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// Most bytes sent at once after a pause, like the 8-byte hardware FIFO of the K70 UART
+#define HOSTUART_TX_BURST 8
+
+// FIFO sizes, the same as UART2 on the tower
+#define HOSTUART_RX_SIZE 256
+#define HOSTUART_TX_SIZE 512
+
+THostUARTStats HostUART_Stats;
+
+/*!
+ * @struct UARTPort
+ */
+struct UARTPort
+{
+  TFIFO rxFIFO;			/*!< The bytes received */
+  TFIFO txFIFO;			/*!< The bytes waiting to be sent */
+  bool open;			/*!< TRUE once the port is attached to a file descriptor */
+  uint8_t rxBuffer[HOSTUART_RX_SIZE];	/*!< The storage for rxFIFO */
+  uint8_t txBuffer[HOSTUART_TX_SIZE];	/*!< The storage for txFIFO */
+};
+
+// Only UART_Port2 is attached to anything, UART_Port1 is there so that the tower code links
+TUARTPort UART_Port1;
+TUARTPort UART_Port2;
+
+static int Fd = -1;               // private global for where the bytes of UART_Port2 go
+static uint32_t BaudRate;         // private global for the simulated baud rate, 0 for unlimited
+static uint32_t CorruptPPM;       // private global for the simulated line noise
+static uint64_t TxCredit;         // private global for bytes the baud rate allows, in 1/1000000ths of a byte
+static uint64_t TxLastMicros;     // private global for when TxCredit was last topped up
+static uint32_t RxMicros;         // private global for when the last bytes were read from Fd
+
+
+
+/*! @brief Reads a monotonic clock.
+ *
+ *  @return uint64_t - Microseconds since an arbitrary start.
+ */
+uint64_t HostUART_Micros(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+
+
+/*! @brief Attaches the simulated UART to a file descriptor.
+ *
+ *  @param fd An open, non-blocking file descriptor.
+ *  @param baudRate The baud rate to limit sending to (10 bits per byte), or 0 to send as fast as possible.
+ *  @param corruptPPM How many received bytes in a million to corrupt, to test recovery from line noise.
+ */
+void HostUART_Open(const int fd, const uint32_t baudRate, const uint32_t corruptPPM)
+{
+  Fd           = fd;
+  BaudRate     = baudRate;
+  CorruptPPM   = corruptPPM;
+  TxCredit     = 0;
+  TxLastMicros = HostUART_Micros();
+  (void)FIFO_INIT(&UART_Port2.rxFIFO, UART_Port2.rxBuffer);
+  (void)FIFO_INIT(&UART_Port2.txFIFO, UART_Port2.txBuffer);
+  UART_Port2.open = true;
+}
+
+
+
+/*! @brief Opens a serial device or pty in raw mode.
+ *
+ *  @param path The device to open.
+ *  @param baudRate The baud rate to set, if the device is a real serial port.
+ *  @return int - A non-blocking file descriptor, or -1 on error.
+ */
+int HostUART_OpenDevice(const char* const path, const uint32_t baudRate)
+{
+  struct termios settings;
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+  if (fd < 0)
+    return -1;
+
+  if (tcgetattr(fd, &settings) == 0)
+  {
+    cfmakeraw(&settings);
+
+    // A pty ignores the speed, so only the standard rates are tried
+    if (baudRate == 115200)
+      cfsetspeed(&settings, B115200);
+    else if (baudRate == 38400)
+      cfsetspeed(&settings, B38400);
+
+    tcsetattr(fd, TCSANOW, &settings);
+  }
+
+  return fd;
+}
+
+
+
+/*! @brief Does the work of the UART interrupt: reads what has arrived and sends what the baud rate allows.
+ *
+ *  @param timeoutMs How long to wait for something to happen, in milliseconds (0 to not wait).
+ *  @return bool - FALSE if the file descriptor has been closed.
+ */
+bool HostUART_Service(const int timeoutMs)
+{
+  struct pollfd fds;
+  uint8_t buffer[256];
+  uint64_t now;
+  ssize_t nbRead;
+  uint32_t nbToSend;
+
+  int wait = timeoutMs;
+
+  // With bytes to send, only wait until the baud rate allows the next ones to go
+  if (FIFO_Count(&UART_Port2.txFIFO) > 0)
+    wait = ((BaudRate > 0) && (timeoutMs > 0)) ? 1 : 0;
+
+  fds.fd      = Fd;
+  fds.events  = POLLIN;
+  fds.revents = 0;
+  poll(&fds, 1, wait);
+
+  if (fds.revents & (POLLERR | POLLNVAL))
+    return false;
+
+  // Receive
+  nbRead = read(Fd, buffer, sizeof(buffer));
+
+  if (nbRead == 0 || ((nbRead < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)))
+    return false;
+
+  for (ssize_t i = 0; (CorruptPPM > 0) && (i < nbRead); i++)
+  {
+    if ((uint32_t)(rand() % 1000000) < CorruptPPM)
+    {
+      buffer[i] ^= (uint8_t)(1 << (rand() % 8));
+      HostUART_Stats.rxCorrupted++;
+    }
+  }
+
+  if (nbRead > 0)
+  {
+    uint16_t nbLost = (uint16_t)nbRead - FIFO_PutN(&UART_Port2.rxFIFO, buffer, (uint16_t)nbRead);
+
+    HostUART_Stats.rxOverruns += nbLost;
+    HostUART_Stats.rxBytes    += (uint64_t)nbRead;
+    RxMicros = (uint32_t)HostUART_Micros();
+  }
+
+  // Transmit, at most as fast as the baud rate
+  now = HostUART_Micros();
+  nbToSend = FIFO_Count(&UART_Port2.txFIFO);
+
+  if (nbToSend > sizeof(buffer))
+    nbToSend = sizeof(buffer);
+
+  if (BaudRate > 0)
+  {
+    TxCredit += (now - TxLastMicros) * (BaudRate / 10);
+
+    if (TxCredit > (uint64_t)HOSTUART_TX_BURST * 1000000)
+      TxCredit = (uint64_t)HOSTUART_TX_BURST * 1000000;
+
+    if (nbToSend > TxCredit / 1000000)
+      nbToSend = (uint32_t)(TxCredit / 1000000);
+
+    TxCredit -= (uint64_t)nbToSend * 1000000;
+  }
+
+  TxLastMicros = now;
+
+  nbToSend = FIFO_GetN(&UART_Port2.txFIFO, buffer, (uint16_t)nbToSend);
+
+  for (uint32_t sent = 0; sent < nbToSend; )
+  {
+    ssize_t nbWritten = write(Fd, &buffer[sent], nbToSend - sent);
+
+    if (nbWritten < 0)
+    {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+        return false;
+
+      poll(&(struct pollfd){ .fd = Fd, .events = POLLOUT }, 1, 10);
+      continue;
+    }
+
+    sent += (uint32_t)nbWritten;
+  }
+
+  HostUART_Stats.txBytes += nbToSend;
+  return true;
+}
+
+
+
+/*! @brief Sets up a UART before first use.
+ *
+ *  @param port The UART to set up.
+ *  @param baudRate Not used, see HostUART_Open.
+ *  @param moduleClk Not used.
+ *  @return bool - TRUE if HostUART_Open has attached the port to a file descriptor.
+ */
+bool UART_PortInit(TUARTPort* const port, const uint32_t baudRate, const uint32_t moduleClk)
+{
+  return port->open;
+}
+
+
+
+/*! @brief Get a character from a receive FIFO if it is not empty.
+ *
+ *  @param port The UART to read from.
+ *  @param dataPtr A pointer to memory to store the retrieved byte.
+ *  @return bool - TRUE if the receive FIFO returned a character.
+ */
+bool UART_PortInChar(TUARTPort* const port, uint8_t* const dataPtr)
+{
+  return FIFO_Get(&port->rxFIFO, dataPtr);
+}
+
+
+
+/*! @brief Describes the bytes waiting in a receive FIFO so that they can be parsed in place.
+ *
+ *  @param port The UART.
+ *  @param span A pointer to where the waiting bytes are described.
+ *  @return uint16_t - The number of bytes in span.
+ */
+uint16_t UART_PortInPeek(TUARTPort* const port, TFIFOSpan* const span)
+{
+  return FIFO_Peek(&port->rxFIFO, span);
+}
+
+
+
+/*! @brief Removes the oldest bytes from a receive FIFO once they have been parsed in place.
+ *
+ *  @param port The UART.
+ *  @param nbBytes The number of bytes parsed, no more than UART_PortInPeek returned.
+ */
+void UART_PortInConsume(TUARTPort* const port, const uint16_t nbBytes)
+{
+  FIFO_Consume(&port->rxFIFO, nbBytes);
+}
+
+
+
+/*! @brief Gets the number of bytes waiting in a receive FIFO.
+ *
+ *  @param port The UART.
+ *  @return uint16_t - The number of received bytes not yet read by UART_PortInChar.
+ */
+uint16_t UART_PortInCount(TUARTPort* const port)
+{
+  return FIFO_Count(&port->rxFIFO);
+}
+
+
+
+/*! @brief Gets when the byte most recently returned by UART_PortInChar arrived.
+ *
+ *  @param port The UART.
+ *  @return uint32_t - The low 32 bits of HostUART_Micros when the bytes were last read, which is close enough on a PC.
+ */
+uint32_t UART_PortInStamp(const TUARTPort* const port)
+{
+  return RxMicros;
+}
+
+
+
+/*! @brief Gets the number of received bytes thrown away because the receive FIFO was full.
+ *
+ *  @param port The UART.
+ *  @return uint32_t - The number of bytes lost since HostUART_Open or UART_PortResetStats.
+ */
+uint32_t UART_PortInDropped(const TUARTPort* const port)
+{
+  return port->rxFIFO.Stats.nbOverflows;
+}
+
+
+
+/*! @brief Gets the usage statistics of a UART's FIFOs.
+ *
+ *  @param port The UART.
+ *  @param rx Where the statistics of the receive FIFO are copied.
+ *  @param tx Where the statistics of the transmit FIFO are copied.
+ */
+void UART_PortGetStats(const TUARTPort* const port, TFIFOStats* const rx, TFIFOStats* const tx)
+{
+  *rx = port->rxFIFO.Stats;
+  *tx = port->txFIFO.Stats;
+}
+
+
+
+/*! @brief Clears the usage statistics of a UART's FIFOs.
+ *
+ *  @param port The UART.
+ */
+void UART_PortResetStats(TUARTPort* const port)
+{
+  FIFO_ResetStats(&port->rxFIFO);
+  FIFO_ResetStats(&port->txFIFO);
+}
+
+
+
+/*! @brief Gets the number of bytes waiting to be sent.
+ *
+ *  @param port The UART.
+ *  @return uint16_t - The number of bytes in the transmit FIFO.
+ */
+uint16_t UART_PortOutCount(const TUARTPort* const port)
+{
+  return FIFO_Count(&port->txFIFO);
+}
+
+
+
+/*! @brief Gets the number of bytes that can still be put in a transmit FIFO.
+ *
+ *  @param port The UART.
+ *  @return uint16_t - The free space in the transmit FIFO.
+ */
+uint16_t UART_PortOutSpace(const TUARTPort* const port)
+{
+  return FIFO_Size(&port->txFIFO) - FIFO_Count(&port->txFIFO);
+}
+
+
+
+/*! @brief Put a byte in a transmit FIFO if it is not full.
+ *
+ *  @param port The UART to send on.
+ *  @param data The byte to be placed in the transmit FIFO.
+ *  @return bool - TRUE if the data was placed in the transmit FIFO.
+ */
+bool UART_PortOutChar(TUARTPort* const port, const uint8_t data)
+{
+  return FIFO_Put(&port->txFIFO, data);
+}
+
+
+
+/*! @brief Reserves space in a transmit FIFO so that bytes can be written straight into it.
+ *
+ *  @param port The UART to send on.
+ *  @param nbBytes The number of bytes to reserve.
+ *  @param span A pointer to where the reserved space is described.
+ *  @return bool - TRUE if the transmit FIFO had room for nbBytes.
+ */
+bool UART_PortOutReserve(TUARTPort* const port, const uint16_t nbBytes, TFIFOSpan* const span)
+{
+  return FIFO_Reserve(&port->txFIFO, nbBytes, span);
+}
+
+
+
+/*! @brief Sends the first bytes of the space reserved by UART_PortOutReserve.
+ *
+ *  @param port The UART to send on.
+ *  @param nbBytes The number of bytes that were written.
+ */
+void UART_PortOutCommit(TUARTPort* const port, const uint16_t nbBytes)
+{
+  FIFO_Commit(&port->txFIFO, nbBytes);
+}
+
+
+
+/*! @brief Moves whatever bytes can be moved without waiting.
+ *
+ *  @param port The UART to poll.
+ */
+void UART_PortPoll(TUARTPort* const port)
+{
+  if (port == &UART_Port2)
+    (void)HostUART_Service(0);
+}
+
+
+
+/*! @brief Moves a UART's receiving and/or transmitting over to DMA.
+ *
+ *  @param port Not used.
+ *  @param mode Not used.
+ *  @return bool - FALSE, as there is no DMA behind a pty and HostUART_Service keeps moving the bytes.
+ */
+bool UART_PortEnableDMA(TUARTPort* const port, const uint8_t mode)
+{
+  (void)port;
+  (void)mode;
+  return false;
+}
+
+
+
+/*! @brief Sets up the UART interface before first use.
+ *
+ *  @param baudRate Not used, see HostUART_Open.
+ *  @param moduleClk Not used.
+ *  @return bool - TRUE if HostUART_Open has been called.
+ */
+bool UART_Init(const uint32_t baudRate, const uint32_t moduleClk)
+{
+  return UART_PortInit(&UART_Port2, baudRate, moduleClk);
+}
+
+
+
+/*! @brief Get a character from the receive FIFO if it is not empty.
+ *
+ *  @param dataPtr A pointer to memory to store the retrieved byte.
+ *  @return bool - TRUE if the receive FIFO returned a character.
+ */
+bool UART_InChar(uint8_t* const dataPtr)
+{
+  return UART_PortInChar(&UART_Port2, dataPtr);
+}
+
+
+
+/*! @brief Gets the number of bytes waiting in the receive FIFO.
+ *
+ *  @return uint16_t - The number of received bytes not yet read by UART_InChar.
+ */
+uint16_t UART_InCount(void)
+{
+  return UART_PortInCount(&UART_Port2);
+}
+
+
+
+/*! @brief Gets when the byte most recently returned by UART_InChar arrived.
+ *
+ *  @return uint32_t - The low 32 bits of HostUART_Micros when the bytes were last read, which is close enough on a PC.
+ */
+uint32_t UART_InStamp(void)
+{
+  return UART_PortInStamp(&UART_Port2);
+}
+
+
+
+/*! @brief Gets the number of bytes waiting to be sent.
+ *
+ *  @return uint16_t - The number of bytes in the transmit FIFO.
+ */
+uint16_t UART_OutCount(void)
+{
+  return UART_PortOutCount(&UART_Port2);
+}
+
+
+
+/*! @brief Put a byte in the transmit FIFO if it is not full.
+ *
+ *  @param data The byte to be placed in the transmit FIFO.
+ *  @return bool - TRUE if the data was placed in the transmit FIFO.
+ */
+bool UART_OutChar(const uint8_t data)
+{
+  return UART_PortOutChar(&UART_Port2, data);
+}
+
+
+
+/*! @brief Reserves space in the transmit FIFO so that bytes can be written straight into it.
+ *
+ *  @param nbBytes The number of bytes to reserve.
+ *  @param span A pointer to where the reserved space is described.
+ *  @return bool - TRUE if the transmit FIFO had room for nbBytes.
+ */
+bool UART_OutReserve(const uint16_t nbBytes, TFIFOSpan* const span)
+{
+  return UART_PortOutReserve(&UART_Port2, nbBytes, span);
+}
+
+
+
+/*! @brief Sends the first bytes of the space reserved by UART_OutReserve.
+ *
+ *  @param nbBytes The number of bytes that were written.
+ */
+void UART_OutCommit(const uint16_t nbBytes)
+{
+  UART_PortOutCommit(&UART_Port2, nbBytes);
+}
+
+
+
+/*! @brief Moves whatever bytes can be moved without waiting.
+ */
+void UART_Poll(void)
+{
+  UART_PortPoll(&UART_Port2);
+}
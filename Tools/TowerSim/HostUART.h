@@ -0,0 +1,63 @@
+/*! @file
+ *
+ *  @brief Simulated UART for building the packet layer on a PC.
+ *
+ *  This contains the functions for moving bytes between the UART FIFOs and a file descriptor
+ *  (a pty or serial port), at a simulated baud rate.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-24
+ */
+
+#ifndef HOSTUART_H
+#define HOSTUART_H
+
+// New types
+#include "types.h"
+
+// The UART functions that the packet layer calls
+#include "UART.h"
+
+/*!
+ * @struct THostUARTStats
+ */
+typedef struct
+{
+  uint64_t rxBytes;		/*!< Bytes read from the file descriptor */
+  uint64_t txBytes;		/*!< Bytes written to the file descriptor */
+  uint32_t rxOverruns;		/*!< Bytes lost because the receive FIFO was full */
+  uint32_t rxCorrupted;		/*!< Bytes deliberately corrupted on the way in */
+} THostUARTStats;
+
+extern THostUARTStats HostUART_Stats;
+
+/*! @brief Attaches the simulated UART to a file descriptor.
+ *
+ *  @param fd An open, non-blocking file descriptor.
+ *  @param baudRate The baud rate to limit sending to (10 bits per byte), or 0 to send as fast as possible.
+ *  @param corruptPPM How many received bytes in a million to corrupt, to test recovery from line noise.
+ */
+void HostUART_Open(const int fd, const uint32_t baudRate, const uint32_t corruptPPM);
+
+/*! @brief Does the work of the UART interrupt: reads what has arrived and sends what the baud rate allows.
+ *
+ *  @param timeoutMs How long to wait for something to happen, in milliseconds (0 to not wait).
+ *  @return bool - FALSE if the file descriptor has been closed.
+ */
+bool HostUART_Service(const int timeoutMs);
+
+/*! @brief Reads a monotonic clock.
+ *
+ *  @return uint64_t - Microseconds since an arbitrary start.
+ */
+uint64_t HostUART_Micros(void);
+
+/*! @brief Opens a serial device or pty in raw mode.
+ *
+ *  @param path The device to open.
+ *  @param baudRate The baud rate to set, if the device is a real serial port.
+ *  @return int - A non-blocking file descriptor, or -1 on error.
+ */
+int HostUART_OpenDevice(const char* const path, const uint32_t baudRate);
+
+#endif
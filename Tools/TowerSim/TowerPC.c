@@ -0,0 +1,505 @@
+/*! @file
+ *
+ *  @brief PC end of the serial protocol, for load and latency testing.
+ *
+ *  This sends a configurable mix of Tower Serial Communication Protocol commands, each asking for an
+ *  acknowledgement, keeping a number of them outstanding at once. It reports the command throughput,
+ *  the bytes per second each way, the time from sending a command to getting its ACK or NAK, and the
+ *  framing errors seen. It uses the tower's own packet module, so it speaks both framings.
+ *  It can also have the tower stream delta compressed accelerometer frames, and decodes each one with
+ *  the tower's Delta_Decode to check it against the data TowerSim sends.
+ *
+ *  It works against TowerSim or a real tower on a serial port.
+ *
+ *  Build, from the top of the project:
+ *
+ *    gcc -std=gnu99 -O2 -Dinterrupt=unused -ITools/TowerSim/Host -ITools/TowerSim -ILibrary -ISources \
+ *        -o towerpc Tools/TowerSim/TowerPC.c Tools/TowerSim/HostUART.c \
+ *        Sources/packet.c Sources/FIFO.c Sources/CRC16.c Sources/delta.c
+ *
+ *  Run:
+ *
+ *    ./towerpc [-b baud] [-n commands] [-t seconds] [-w window] [-m mix] [-c] [-e corrupt ppm] [-d samples] device
+ *
+ *  mix is a list of command:weight, e.g. version:4,readbyte:2,settime:1 (the default is an even mix).
+ *  The commands are startup, version, number, mode, readbyte, progbyte, settime and badtime
+ *  (an out of range Set Time, which the tower NAKs). -c switches both ends to COBS framing for the test.
+ *  -d asks for delta compressed frames of that many samples, which needs -c and TowerSim run with -a.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-24
+ */
+
+#define _GNU_SOURCE
+
+#include "packet.h"
+#include "delta.h"
+#include "HostUART.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Commands, as in main.c
+#define CMD_STARTUP   0x04
+#define CMD_VERSION   0x09
+#define CMD_NUMBER    0x0B
+#define CMD_TOWERMODE 0x0D
+#define CMD_PROGBYTE  0x07
+#define CMD_READBYTE  0x08
+#define CMD_SETTIME   0x0C
+#define CMD_FRAMING   0x16
+#define CMD_ACCELDELTA 0x17
+
+// Most commands waiting for an ACK at once
+#define MAX_WINDOW 64
+
+// Most latencies kept for the percentiles
+#define MAX_LATENCIES (1 << 20)
+
+/*!
+ * @struct TCommandType
+ */
+typedef struct
+{
+  const char* name;		/*!< The name used in the mix */
+  uint8_t command;		/*!< The command sent */
+  uint32_t weight;		/*!< How often it is sent, relative to the others */
+} TCommandType;
+
+/*!
+ * @struct TOutstanding
+ */
+typedef struct
+{
+  TPacket packet;		/*!< The command as sent, without the ACK bit */
+  uint64_t sentMicros;		/*!< When it was put in the transmit FIFO */
+  uint64_t echoMicros;		/*!< When the echo was received */
+  bool echoed;			/*!< TRUE once a reply identical to the command has been seen, i.e. a NAK unless an ACK follows */
+} TOutstanding;
+
+static TCommandType CommandTypes[] =
+{
+  { "startup",  CMD_STARTUP,   1 },
+  { "version",  CMD_VERSION,   1 },
+  { "number",   CMD_NUMBER,    1 },
+  { "mode",     CMD_TOWERMODE, 1 },
+  { "readbyte", CMD_READBYTE,  1 },
+  { "progbyte", CMD_PROGBYTE,  1 },
+  { "settime",  CMD_SETTIME,   1 },
+  { "badtime",  CMD_SETTIME,   0 },
+};
+
+#define NB_COMMAND_TYPES (sizeof(CommandTypes) / sizeof(CommandTypes[0]))
+
+static volatile sig_atomic_t Running = 1;
+
+static TOutstanding Window[MAX_WINDOW]; // commands waiting for an ACK, oldest first, as a ring
+static uint16_t WindowStart;
+static uint16_t WindowCount;
+
+static uint32_t* Latencies;
+static uint32_t NbLatencies;
+
+static uint64_t NbSent, NbAcked, NbNaked, NbLost, NbReplies, NbUnexpected;
+
+static uint64_t NbDeltaFrames, NbDeltaSamples, NbDeltaBad, NbDeltaLost;
+static uint8_t DeltaSequence; // the sequence number expected on the next delta frame
+
+
+
+// Takes the oldest command out of the window
+static void Retire(void)
+{
+  WindowStart = (WindowStart + 1) % MAX_WINDOW;
+  WindowCount--;
+}
+
+// Takes the oldest command out of the window once it is known that it will not be ACKed
+static void RetireUnacked(void)
+{
+  if (Window[WindowStart].echoed)
+  {
+    NbNaked++;
+
+    if (NbLatencies < MAX_LATENCIES)
+      Latencies[NbLatencies++] = (uint32_t)(Window[WindowStart].echoMicros - Window[WindowStart].sentMicros);
+  }
+  else
+    NbLost++;
+
+  Retire();
+}
+
+// Called by Packet_Handle for every packet from the tower
+static bool ReplyHandler(const TPacket* const packet)
+{
+  bool ack = (PACKET_COMMAND(packet) & PACKET_ACK_MASK) != 0;
+  TPacket reply = *packet;
+  uint16_t match;
+
+  reply.packetStruct.command &= ~PACKET_ACK_MASK;
+
+  // Find the command this is the ACK/NAK of: same command and parameters
+  for (match = 0; match < WindowCount; match++)
+  {
+    TOutstanding* outstanding = &Window[(WindowStart + match) % MAX_WINDOW];
+
+    if (memcmp(outstanding->packet.bytes, reply.bytes, PACKET_NB_BYTES - 1) == 0)
+      break;
+  }
+
+  if (match == WindowCount)
+  {
+    if (ack)
+      NbUnexpected++;
+    else
+      NbReplies++; // data sent back by a command, or sent by the tower on its own
+    return true;
+  }
+
+  if (!ack) // Either a NAK, or a reply that happens to look like the command; decided by what comes next
+  {
+    Window[(WindowStart + match) % MAX_WINDOW].echoed     = true;
+    Window[(WindowStart + match) % MAX_WINDOW].echoMicros = HostUART_Micros();
+    return true;
+  }
+
+  // Everything sent before it should have been answered already
+  while (match-- > 0)
+    RetireUnacked();
+
+  if (NbLatencies < MAX_LATENCIES)
+    Latencies[NbLatencies++] = (uint32_t)(HostUART_Micros() - Window[WindowStart].sentMicros);
+
+  NbAcked++;
+  Retire();
+  return true;
+}
+
+// Called by Packet_Handle for every delta compressed frame, to check that it decodes to TowerSim's sawtooth
+static bool DeltaHandler(const TPacket* const packet)
+{
+  TAccelData samples[DELTA_MAX_SAMPLES];
+  uint8_t nbSamples = Delta_Decode(Packet_FrameData, Packet_FrameLength, samples);
+
+  if (nbSamples == 0)
+  {
+    NbDeltaBad++;
+    return true;
+  }
+
+  // Frames lost on the way show up as a jump in the sequence numbers
+  if (NbDeltaFrames > 0)
+    NbDeltaLost += (uint8_t)(Packet_FrameData[0] - DeltaSequence);
+
+  DeltaSequence = Packet_FrameData[0] + 1;
+  NbDeltaFrames++;
+
+  for (uint8_t i = 0; i < nbSamples; i++)
+  {
+    uint8_t phase = samples[0].axes.x + i;
+
+    if ((samples[i].axes.x != phase) || (samples[i].axes.y != (uint8_t)-(phase * 2)) ||
+        (samples[i].axes.z != (uint8_t)(phase * 37)))
+    {
+      NbDeltaBad++;
+      break;
+    }
+  }
+
+  NbDeltaSamples += nbSamples;
+  return true;
+}
+
+// Retires commands that have not been ACKed in time
+static void Expire(const uint64_t timeoutMicros)
+{
+  uint64_t now = HostUART_Micros();
+
+  while ((WindowCount > 0) && (now - Window[WindowStart].sentMicros > timeoutMicros))
+    RetireUnacked();
+}
+
+// Picks a command from the mix and sends it
+static bool SendCommand(const uint32_t totalWeight)
+{
+  uint32_t pick = (uint32_t)rand() % totalWeight;
+  const TCommandType* type = CommandTypes;
+  TOutstanding* outstanding = &Window[(WindowStart + WindowCount) % MAX_WINDOW];
+  uint8_t parameter1 = 0, parameter2 = 0, parameter3 = 0;
+
+  while (pick >= type->weight)
+  {
+    pick -= type->weight;
+    type++;
+  }
+
+  switch (type->command)
+  {
+    case CMD_NUMBER:
+    case CMD_TOWERMODE:
+      parameter1 = 1; // GET
+      break;
+    case CMD_READBYTE:
+      parameter1 = (uint8_t)(rand() % 8);
+      break;
+    case CMD_PROGBYTE:
+      parameter1 = (uint8_t)(rand() % 8);
+      parameter3 = (uint8_t)rand();
+      break;
+    case CMD_SETTIME:
+      parameter1 = (strcmp(type->name, "badtime") == 0) ? 24 : (uint8_t)(rand() % 24);
+      parameter2 = (uint8_t)(rand() % 60);
+      parameter3 = (uint8_t)(rand() % 60);
+      break;
+  }
+
+  if (!Packet_Put(type->command | PACKET_ACK_MASK, parameter1, parameter2, parameter3))
+    return false;
+
+  outstanding->packet.packetStruct.command = type->command;
+  outstanding->packet.packetStruct.parameters.separate.parameter1 = parameter1;
+  outstanding->packet.packetStruct.parameters.separate.parameter2 = parameter2;
+  outstanding->packet.packetStruct.parameters.separate.parameter3 = parameter3;
+  outstanding->sentMicros = HostUART_Micros();
+  outstanding->echoed     = false;
+  WindowCount++;
+  NbSent++;
+  return true;
+}
+
+static int CompareLatencies(const void* a, const void* b)
+{
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return (x > y) - (x < y);
+}
+
+static uint32_t Percentile(const uint32_t percent)
+{
+  if (NbLatencies == 0)
+    return 0;
+
+  return Latencies[((uint64_t)(NbLatencies - 1) * percent) / 100];
+}
+
+static bool ParseMix(char* mix)
+{
+  for (uint8_t i = 0; i < NB_COMMAND_TYPES; i++)
+    CommandTypes[i].weight = 0;
+
+  for (char* item = strtok(mix, ","); item != NULL; item = strtok(NULL, ","))
+  {
+    char* colon = strchr(item, ':');
+    uint8_t i;
+
+    if (colon != NULL)
+      *colon = '\0';
+
+    for (i = 0; i < NB_COMMAND_TYPES; i++)
+      if (strcmp(item, CommandTypes[i].name) == 0)
+        break;
+
+    if (i == NB_COMMAND_TYPES)
+      return false;
+
+    CommandTypes[i].weight = (colon != NULL) ? (uint32_t)strtoul(colon + 1, NULL, 0) : 1;
+  }
+
+  return true;
+}
+
+// Sends a command outside the test and waits up to a second for its ACK, throwing away anything else received
+static bool Command(const uint8_t command, const uint8_t parameter1, const uint8_t parameter2, const uint8_t parameter3)
+{
+  uint64_t start = HostUART_Micros();
+
+  if (!Packet_Put(command | PACKET_ACK_MASK, parameter1, parameter2, parameter3))
+    return false;
+
+  while (HostUART_Micros() - start < 1000000)
+  {
+    if (!HostUART_Service(1))
+      return false;
+
+    while (Packet_Get())
+    {
+      if (Packet_Command == (command | PACKET_ACK_MASK))
+        return true;
+    }
+  }
+
+  return false;
+}
+
+// Switches the tower, and then this end, to a framing
+static bool SetFraming(const TPacketFraming framing)
+{
+  return Command(CMD_FRAMING, 2, framing, 0) && Packet_SetFraming(framing);
+}
+
+static void Stop(int signal)
+{
+  Running = 0;
+}
+
+static void Usage(void)
+{
+  fprintf(stderr, "usage: towerpc [-b baud] [-n commands] [-t seconds] [-w window] [-m mix] [-c] [-e corrupt ppm] [-d samples] device\n");
+  exit(2);
+}
+
+
+
+int main(int argc, char* argv[])
+{
+  uint32_t baudRate   = 115200;
+  uint64_t nbCommands = 0;
+  uint32_t seconds    = 10;
+  uint16_t window     = 1;
+  uint32_t corruptPPM = 0;
+  uint8_t deltaSamples = 0;
+  uint64_t timeoutMicros = 500000;
+  bool cobs = false;
+  uint32_t totalWeight = 0;
+  uint64_t start, lastReport, now;
+  int option, fd;
+
+  while ((option = getopt(argc, argv, "b:n:t:w:m:ce:d:")) != -1)
+  {
+    switch (option)
+    {
+      case 'b': baudRate   = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'n': nbCommands = strtoull(optarg, NULL, 0); seconds = 0; break;
+      case 't': seconds    = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'w': window     = (uint16_t)strtoul(optarg, NULL, 0); break;
+      case 'm': if (!ParseMix(optarg)) Usage(); break;
+      case 'c': cobs       = true; break;
+      case 'e': corruptPPM = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'd': deltaSamples = (uint8_t)strtoul(optarg, NULL, 0); break;
+      default:  Usage();
+    }
+  }
+
+  // Frames are only received with COBS framing
+  if ((optind != argc - 1) || (window == 0) || (window > MAX_WINDOW) ||
+      (deltaSamples > DELTA_MAX_SAMPLES) || ((deltaSamples > 0) && !cobs))
+    Usage();
+
+  for (uint8_t i = 0; i < NB_COMMAND_TYPES; i++)
+    totalWeight += CommandTypes[i].weight;
+
+  if (totalWeight == 0)
+    Usage();
+
+  fd = HostUART_OpenDevice(argv[optind], baudRate);
+
+  if (fd < 0)
+  {
+    perror("towerpc: open");
+    return 1;
+  }
+
+  Latencies = malloc(MAX_LATENCIES * sizeof(*Latencies));
+  HostUART_Open(fd, baudRate, corruptPPM);
+
+  // Every command the tower can send back
+  for (uint8_t command = CMD_STARTUP; command <= CMD_FRAMING; command++)
+    Packet_RegisterHandler(command, ReplyHandler);
+
+  Packet_RegisterHandler(CMD_ACCELDELTA, DeltaHandler);
+
+  if ((Latencies == NULL) || !Packet_Init(baudRate, 0))
+  {
+    fprintf(stderr, "towerpc: could not start the packet module\n");
+    return 1;
+  }
+
+  if (cobs && !SetFraming(PACKET_FRAMING_COBS))
+  {
+    fprintf(stderr, "towerpc: the tower did not ACK the switch to COBS framing\n");
+    return 1;
+  }
+
+  if ((deltaSamples > 0) && !Command(CMD_ACCELDELTA, 2, deltaSamples, 0))
+  {
+    fprintf(stderr, "towerpc: the tower did not ACK the start of delta compressed frames\n");
+    return 1;
+  }
+
+  signal(SIGINT, Stop);
+  signal(SIGTERM, Stop);
+
+  start = lastReport = HostUART_Micros();
+
+  for (;;)
+  {
+    bool sending;
+
+    now = HostUART_Micros();
+    sending = Running &&
+              ((nbCommands == 0) || (NbSent < nbCommands)) &&
+              ((seconds == 0) || (now - start < (uint64_t)seconds * 1000000));
+
+    if (!sending && (WindowCount == 0))
+      break;
+
+    while (sending && (WindowCount < window) && SendCommand(totalWeight))
+      sending = (nbCommands == 0) || (NbSent < nbCommands);
+
+    if (!HostUART_Service(1))
+    {
+      fprintf(stderr, "towerpc: %s closed\n", argv[optind]);
+      break;
+    }
+
+    while (Packet_Get())
+      Packet_Handle(&Packet);
+
+    Expire(timeoutMicros);
+
+    if (now - lastReport >= 1000000)
+    {
+      lastReport = now;
+      printf("%6.1f s: %llu sent, %llu ACK, %llu NAK, %llu lost, %u framing errors\n",
+             (now - start) / 1e6, (unsigned long long)NbSent, (unsigned long long)NbAcked,
+             (unsigned long long)NbNaked, (unsigned long long)NbLost, Packet_FramingErrors);
+      fflush(stdout);
+    }
+  }
+
+  now = HostUART_Micros();
+
+  // Leave the tower as it was found
+  if ((deltaSamples > 0) && !Command(CMD_ACCELDELTA, 2, 0, 0))
+    fprintf(stderr, "towerpc: the tower did not ACK the end of delta compressed frames\n");
+
+  if (cobs && !SetFraming(PACKET_FRAMING_FIXED))
+    fprintf(stderr, "towerpc: the tower did not ACK the switch back to fixed framing\n");
+
+  qsort(Latencies, NbLatencies, sizeof(*Latencies), CompareLatencies);
+
+  printf("\n%llu commands in %.2f s (window %u, %s framing, %u baud)\n", (unsigned long long)NbSent,
+         (now - start) / 1e6, window, cobs ? "COBS" : "fixed", baudRate);
+  printf("  %llu ACK, %llu NAK, %llu lost, %llu replies, %llu unexpected ACKs\n",
+         (unsigned long long)NbAcked, (unsigned long long)NbNaked, (unsigned long long)NbLost,
+         (unsigned long long)NbReplies, (unsigned long long)NbUnexpected);
+  printf("  throughput %.1f commands/s, tx %.0f bytes/s, rx %.0f bytes/s\n",
+         (NbAcked + NbNaked) * 1e6 / (now - start), HostUART_Stats.txBytes * 1e6 / (now - start),
+         HostUART_Stats.rxBytes * 1e6 / (now - start));
+  printf("  latency us: p50 %u, p90 %u, p99 %u, max %u\n",
+         Percentile(50), Percentile(90), Percentile(99), Percentile(100));
+  printf("  %u framing errors, %u receive overruns, %u bytes corrupted\n",
+         Packet_FramingErrors, HostUART_Stats.rxOverruns, HostUART_Stats.rxCorrupted);
+
+  if (deltaSamples > 0)
+    printf("  %llu delta frames, %llu samples, %llu bad, %llu lost\n",
+           (unsigned long long)NbDeltaFrames, (unsigned long long)NbDeltaSamples,
+           (unsigned long long)NbDeltaBad, (unsigned long long)NbDeltaLost);
+
+  free(Latencies);
+  return 0;
+}
@@ -0,0 +1,342 @@
+/*! @file
+ *
+ *  @brief Tower stand-in for testing the serial protocol on a PC.
+ *
+ *  This runs the tower's packet, FIFO and CRC modules on a PC, behind a pty instead of UART2,
+ *  and answers the basic Tower Serial Communication Protocol commands the same way main.c does.
+ *  With -a it also streams accelerometer data, as Accelerometer packets or, once the PC asks with the
+ *  Accel Delta command, as delta compressed frames, so that the PC can check them against Delta_Decode.
+ *
+ *  Build, from the top of the project:
+ *
+ *    gcc -std=gnu99 -O2 -Dinterrupt=unused -ITools/TowerSim/Host -ITools/TowerSim -ILibrary -ISources \
+ *        -o towersim Tools/TowerSim/TowerSim.c Tools/TowerSim/HostUART.c \
+ *        Sources/packet.c Sources/FIFO.c Sources/CRC16.c Sources/delta.c
+ *
+ *  Run:
+ *
+ *    ./towersim [-b baud] [-a accel Hz] [-e corrupt ppm] [-l link]
+ *
+ *  It prints the pty to connect to (and makes link a symlink to it), e.g. for TowerPC.
+ *
+ *  @author Thanit Tangson
+ *  @date 2017-5-24
+ */
+
+#define _GNU_SOURCE
+
+#include "packet.h"
+#include "delta.h"
+#include "Cpu.h"
+#include "HostUART.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+// Commands, as in main.c
+#define CMD_STARTUP   0x04
+#define CMD_VERSION   0x09
+#define CMD_NUMBER    0x0B
+#define CMD_TOWERMODE 0x0D
+#define CMD_PROGBYTE  0x07
+#define CMD_READBYTE  0x08
+#define CMD_SETTIME   0x0C
+#define CMD_ACCEL     0x10
+#define CMD_FRAMING   0x16
+#define CMD_ACCELDELTA 0x17
+
+// Most packets handled per pass, as in main.c
+#define DISPATCH_MAX_PACKETS 8
+
+static volatile sig_atomic_t Running = 1;
+
+static uint16union_t TowerNumber = { 5696 };
+static uint16union_t TowerMode   = { 1 };
+static uint8_t FlashBytes[8]     = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+static uint8_t Hours, Minutes, Seconds;
+
+static bool FramingChange = false;
+static TPacketFraming NewFraming;
+
+static TDeltaEncoder AccelDelta;
+static bool DeltaStream = false;
+
+
+
+static bool HandleStartupPacket(const TPacket* const packet)
+{
+  return (Packet_Put(CMD_STARTUP, 0x00, 0x00, 0x00) &&
+          Packet_Put(CMD_VERSION, 'v', 0x01, 0x00) &&
+          Packet_Put(CMD_NUMBER, 0x01, TowerNumber.s.Lo, TowerNumber.s.Hi) &&
+          Packet_Put(CMD_TOWERMODE, 0x01, TowerMode.s.Lo, TowerMode.s.Hi));
+}
+
+static bool HandleVersionPacket(const TPacket* const packet)
+{
+  return Packet_Put(CMD_VERSION, 'v', 0x01, 0x00);
+}
+
+static bool HandleNumberPacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) == 0x02)
+    TowerNumber.l = PACKET_PARAMETER23(packet);
+  else if (PACKET_PARAMETER1(packet) != 0x01)
+    return false;
+
+  return Packet_Put(CMD_NUMBER, 0x01, TowerNumber.s.Lo, TowerNumber.s.Hi);
+}
+
+static bool HandleTowerModePacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) == 0x02)
+    TowerMode.l = PACKET_PARAMETER23(packet);
+  else if (PACKET_PARAMETER1(packet) != 0x01)
+    return false;
+
+  return Packet_Put(CMD_TOWERMODE, 0x01, TowerMode.s.Lo, TowerMode.s.Hi);
+}
+
+static bool HandleProgBytePacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) > 8)
+    return false;
+
+  if (PACKET_PARAMETER1(packet) == 8) // erase
+  {
+    for (uint8_t i = 0; i < sizeof(FlashBytes); i++)
+      FlashBytes[i] = 0xFF;
+    return true;
+  }
+
+  // Flash can only clear bits
+  FlashBytes[PACKET_PARAMETER1(packet)] &= PACKET_PARAMETER3(packet);
+  return true;
+}
+
+static bool HandleReadBytePacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) > 7)
+    return false;
+
+  return Packet_Put(CMD_READBYTE, PACKET_PARAMETER1(packet), 0x00, FlashBytes[PACKET_PARAMETER1(packet)]);
+}
+
+static bool HandleSetTimePacket(const TPacket* const packet)
+{
+  if ((PACKET_PARAMETER1(packet) > 23) || (PACKET_PARAMETER2(packet) > 59) || (PACKET_PARAMETER3(packet) > 59))
+    return false;
+
+  Hours   = PACKET_PARAMETER1(packet);
+  Minutes = PACKET_PARAMETER2(packet);
+  Seconds = PACKET_PARAMETER3(packet);
+  return Packet_Put(CMD_SETTIME, Seconds, Minutes, Hours);
+}
+
+static bool HandleFramingPacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) == 0x02)
+  {
+    if (PACKET_PARAMETER2(packet) > PACKET_FRAMING_COBS)
+      return false;
+
+    NewFraming    = (TPacketFraming)PACKET_PARAMETER2(packet);
+    FramingChange = true;
+    return true;
+  }
+  else if (PACKET_PARAMETER1(packet) == 0x01)
+    return Packet_Put(CMD_FRAMING, 1, Packet_GetFraming(), 0);
+
+  return false;
+}
+
+static bool HandleAccelDeltaPacket(const TPacket* const packet)
+{
+  if (PACKET_PARAMETER1(packet) == 0x02)
+  {
+    if (PACKET_PARAMETER2(packet) == 0)
+    {
+      DeltaStream = false;
+      return true;
+    }
+
+    DeltaStream = Delta_Init(&AccelDelta, PACKET_PARAMETER2(packet));
+    return DeltaStream;
+  }
+  else if (PACKET_PARAMETER1(packet) == 0x01)
+    return Packet_Put(CMD_ACCELDELTA, 1, DeltaStream ? AccelDelta.samplesPerFrame : 0, 0);
+
+  return false;
+}
+
+// Sends one accelerometer sample, as an Accelerometer packet or into the delta compressed stream
+static void SendAccel(const uint8_t phase)
+{
+  TAccelData data;
+  uint8_t length;
+
+  // A sawtooth on each axis, falling on Y and steep on Z so the delta frames also hold negative and escaped deltas
+  data.axes.x = phase;
+  data.axes.y = (uint8_t)-(phase * 2);
+  data.axes.z = (uint8_t)(phase * 37);
+
+  if (!DeltaStream)
+  {
+    Packet_Put(CMD_ACCEL, data.axes.x, data.axes.y, data.axes.z);
+    return;
+  }
+
+  length = Delta_Put(&AccelDelta, &data);
+
+  if (length > 0)
+    Packet_PutFrame(CMD_ACCELDELTA, AccelDelta.frame, length);
+}
+
+// Same ACK/NAK handling as HandlePacket in main.c
+static void HandlePacket(void)
+{
+  bool ackReq  = false;
+  bool success;
+
+  if (Packet_Command & PACKET_ACK_MASK)
+  {
+    ackReq = true;
+    Packet_Command &= ~PACKET_ACK_MASK;
+  }
+
+  success = Packet_Handle(&Packet);
+
+  if (ackReq)
+  {
+    if (success)
+      Packet_Command |= PACKET_ACK_MASK;
+
+    Packet_Put(Packet_Command, Packet_Parameter1, Packet_Parameter2, Packet_Parameter3);
+  }
+
+  if (FramingChange)
+  {
+    FramingChange = false;
+    Packet_SetFraming(NewFraming);
+  }
+}
+
+static void Stop(int signal)
+{
+  Running = 0;
+}
+
+static void Usage(void)
+{
+  fprintf(stderr, "usage: towersim [-b baud] [-a accel Hz] [-e corrupt ppm] [-l link]\n");
+  exit(2);
+}
+
+
+
+int main(int argc, char* argv[])
+{
+  uint32_t baudRate   = 115200;
+  uint32_t accelHz    = 0;
+  uint32_t corruptPPM = 0;
+  const char* link    = NULL;
+  uint64_t nextAccel;
+  uint8_t accelPhase  = 0;
+  int master, slave;
+  int option;
+
+  while ((option = getopt(argc, argv, "b:a:e:l:")) != -1)
+  {
+    switch (option)
+    {
+      case 'b': baudRate   = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'a': accelHz    = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'e': corruptPPM = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'l': link       = optarg; break;
+      default:  Usage();
+    }
+  }
+
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+
+  if ((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0))
+  {
+    perror("towersim: pty");
+    return 1;
+  }
+
+  // Keep the slave open in raw mode, so the line discipline leaves the bytes alone and the PC end can come and go
+  slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  {
+    struct termios settings;
+    tcgetattr(slave, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(slave, TCSANOW, &settings);
+  }
+
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+  if (link != NULL)
+  {
+    unlink(link);
+
+    if (symlink(ptsname(master), link) != 0)
+      perror("towersim: symlink");
+  }
+
+  printf("towersim: tower on %s, %u baud\n", ptsname(master), baudRate);
+  fflush(stdout);
+
+  signal(SIGINT, Stop);
+  signal(SIGTERM, Stop);
+
+  HostUART_Open(master, baudRate, corruptPPM);
+
+  if (!Packet_Init(baudRate, CPU_BUS_CLK_HZ) ||
+      !Packet_RegisterHandler(CMD_STARTUP, HandleStartupPacket) ||
+      !Packet_RegisterHandler(CMD_VERSION, HandleVersionPacket) ||
+      !Packet_RegisterHandler(CMD_NUMBER, HandleNumberPacket) ||
+      !Packet_RegisterHandler(CMD_TOWERMODE, HandleTowerModePacket) ||
+      !Packet_RegisterHandler(CMD_PROGBYTE, HandleProgBytePacket) ||
+      !Packet_RegisterHandler(CMD_READBYTE, HandleReadBytePacket) ||
+      !Packet_RegisterHandler(CMD_SETTIME, HandleSetTimePacket) ||
+      !Packet_RegisterHandler(CMD_FRAMING, HandleFramingPacket) ||
+      !Packet_RegisterHandler(CMD_ACCELDELTA, HandleAccelDeltaPacket))
+  {
+    fprintf(stderr, "towersim: could not start the packet module\n");
+    return 1;
+  }
+
+  nextAccel = HostUART_Micros();
+
+  while (Running)
+  {
+    if (!HostUART_Service(1))
+      break;
+
+    for (uint8_t i = 0; (i < DISPATCH_MAX_PACKETS) && Packet_Get(); i++)
+      HandlePacket();
+
+    // Background accelerometer data
+    if ((accelHz > 0) && (HostUART_Micros() >= nextAccel))
+    {
+      nextAccel += 1000000 / accelHz;
+      accelPhase++;
+      SendAccel(accelPhase);
+    }
+  }
+
+  printf("towersim: rx %llu bytes, tx %llu bytes, %u framing errors, %u overruns, %u corrupted\n",
+         (unsigned long long)HostUART_Stats.rxBytes, (unsigned long long)HostUART_Stats.txBytes,
+         Packet_FramingErrors, HostUART_Stats.rxOverruns, HostUART_Stats.rxCorrupted);
+
+  if (link != NULL)
+    unlink(link);
+
+  close(slave);
+  close(master);
+  return 0;
+}